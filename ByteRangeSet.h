@@ -0,0 +1,63 @@
+// ByteRangeSet.h
+//
+// Set of disjoint half-open byte ranges [start, end), kept as an ordered map from start to end.
+// Used to split a memory location into the bytes a write covered and the gaps that still need
+// a writer of their own.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <utility>
+#include <vector>
+
+class ByteRangeSet {
+public:
+    // Adds [start, end), merging with overlapping and adjacent ranges.
+    void Add(uint64_t start, uint64_t end) {
+        if (start >= end) return;
+
+        auto it = m_ranges.upper_bound(start);
+        if (it != m_ranges.begin()) {
+            auto prev = std::prev(it);
+            if (prev->second >= start) {
+                start = prev->first;
+                end = std::max(end, prev->second);
+                it = m_ranges.erase(prev);
+            }
+        }
+
+        while (it != m_ranges.end() && it->first <= end) {
+            end = std::max(end, it->second);
+            it = m_ranges.erase(it);
+        }
+
+        m_ranges.emplace(start, end);
+    }
+
+    // The parts of [start, end) not in the set, in address order.
+    std::vector<std::pair<uint64_t, uint64_t>> GetGaps(uint64_t start, uint64_t end) const {
+        std::vector<std::pair<uint64_t, uint64_t>> gaps;
+
+        uint64_t cursor = start;
+        auto it = m_ranges.upper_bound(start);
+        if (it != m_ranges.begin()) --it;
+
+        for (; it != m_ranges.end() && it->first < end; ++it) {
+            if (it->second <= cursor) continue;
+            if (it->first > cursor) gaps.emplace_back(cursor, it->first);
+            cursor = std::max(cursor, it->second);
+        }
+        if (cursor < end) gaps.emplace_back(cursor, end);
+
+        return gaps;
+    }
+
+    bool IsEmpty() const { return m_ranges.empty(); }
+    uint64_t GetStart() const { return m_ranges.begin()->first; }
+    uint64_t GetEnd() const { return std::prev(m_ranges.end())->second; }
+
+private:
+    std::map<uint64_t, uint64_t> m_ranges;
+};
@@ -0,0 +1,108 @@
+#include "DecodeCache.h"
+
+#include <cstring>
+
+#include <TTD/IReplayEngineStl.h>
+
+#include "disasm_helper.h"
+#include "TrackStats.h"
+
+void DecodeCache::BindTo(const void* trace, ProcessorArchitecture cpuType)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_trace == trace && m_cpuType == cpuType) return;
+
+    m_pages.clear();
+    m_trace = trace;
+    m_cpuType = cpuType;
+
+    SetupZydisDecoder(&m_decoder, cpuType);
+    ZydisFormatterInit(&m_formatter, ZYDIS_FORMATTER_STYLE_INTEL);
+}
+
+void DecodeCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pages.clear();
+    m_hits = 0;
+    m_misses = 0;
+    m_invalidations = 0;
+}
+
+std::shared_ptr<const DecodedInstruction> DecodeCache::Get(ICursor* cursor)
+{
+    uint64_t pc = (uint64_t)cursor->GetProgramCounter();
+
+    uint8_t bytes[ZYDIS_MAX_INSTRUCTION_LENGTH] = {};
+    BufferView bufferView{ bytes, sizeof(bytes) };
+    cursor->QueryMemoryBuffer((GuestAddress)pc, bufferView);
+
+    return Lookup(pc, bytes);
+}
+
+std::shared_ptr<const DecodedInstruction> DecodeCache::Get(const IThreadView* thread)
+{
+    uint64_t pc = (uint64_t)thread->GetProgramCounter();
+
+    uint8_t bytes[ZYDIS_MAX_INSTRUCTION_LENGTH] = {};
+    BufferView bufferView{ bytes, sizeof(bytes) };
+    thread->QueryMemoryBuffer((GuestAddress)pc, bufferView);
+
+    return Lookup(pc, bytes);
+}
+
+std::shared_ptr<const DecodedInstruction> DecodeCache::Lookup(uint64_t pc, const uint8_t* bytes)
+{
+    uint64_t page = pc >> c_pageShift;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto pageIt = m_pages.find(page);
+        if (pageIt != m_pages.end()) {
+            auto it = pageIt->second.find(pc);
+            if (it != pageIt->second.end()) {
+                const DecodedInstruction& cached = *it->second;
+                if (memcmp(cached.bytes, bytes, cached.instruction.length) == 0) {
+                    m_hits++;
+                    return it->second;
+                }
+
+                // The code changed since it was cached; the rest of the page likely did too.
+                m_pages.erase(pageIt);
+                m_invalidations++;
+            }
+        }
+    }
+
+    m_misses++;
+    ScopedPhaseTimer timer(TrackPhase::Decode);
+
+    auto decoded = std::make_shared<DecodedInstruction>();
+    memcpy(decoded->bytes, bytes, sizeof(decoded->bytes));
+
+    if (ZYAN_FAILED(ZydisDecoderDecodeFull(&m_decoder, decoded->bytes, sizeof(decoded->bytes), &decoded->instruction, decoded->operands))) {
+        return nullptr;
+    }
+
+    char buffer[256];
+    if (ZYAN_SUCCESS(ZydisFormatterFormatInstruction(&m_formatter, &decoded->instruction, decoded->operands,
+        decoded->instruction.operand_count_visible, buffer, sizeof(buffer), pc, ZYAN_NULL))) {
+        decoded->text = buffer;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pages[page][pc] = decoded;
+    return decoded;
+}
+
+size_t DecodeCache::GetEntryCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t count = 0;
+    for (const auto& [page, entries] : m_pages) {
+        count += entries.size();
+    }
+    return count;
+}
@@ -0,0 +1,65 @@
+// DecodeCache.h
+//
+// Session-wide cache of decoded and formatted instructions, shared by the tracking workers, the
+// printer and the GUI loader. Entries are grouped by 4 KB code page and keyed by PC. Every lookup
+// still reads the code bytes at the current position and compares them with the cached ones, so
+// self-modifying or JIT code that changes between positions drops the stale page.
+#pragma once
+#include "stdafx.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <TTD/IReplayEngine.h>
+#include <Zydis/Zydis.h>
+
+using namespace TTD;
+using namespace Replay;
+
+struct DecodedInstruction {
+    uint8_t bytes[ZYDIS_MAX_INSTRUCTION_LENGTH] = {};
+    ZydisDecodedInstruction instruction = {};
+    ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT] = {};
+    std::string text; // Intel syntax, formatted for the cached PC
+};
+
+class DecodeCache {
+public:
+    // Drops every entry when the trace or the architecture changes.
+    void BindTo(const void* trace, ProcessorArchitecture cpuType);
+    void Clear();
+
+    // Thread-safe. The instruction at the program counter of 'cursor' / 'thread',
+    // nullptr when the bytes there do not decode.
+    std::shared_ptr<const DecodedInstruction> Get(ICursor* cursor);
+    std::shared_ptr<const DecodedInstruction> Get(const IThreadView* thread);
+
+    uint64_t GetHits() const { return m_hits; }
+    uint64_t GetMisses() const { return m_misses; }
+    uint64_t GetInvalidations() const { return m_invalidations; }
+    size_t GetEntryCount();
+
+private:
+    static constexpr unsigned c_pageShift = 12;
+
+    using Page = std::unordered_map<uint64_t, std::shared_ptr<const DecodedInstruction>>;
+
+    std::shared_ptr<const DecodedInstruction> Lookup(uint64_t pc, const uint8_t* bytes);
+
+    std::mutex m_mutex;
+    std::unordered_map<uint64_t, Page> m_pages;
+
+    const void* m_trace = nullptr;
+    ProcessorArchitecture m_cpuType = ProcessorArchitecture::Invalid;
+    ZydisDecoder m_decoder = {};
+    ZydisFormatter m_formatter = {};
+
+    std::atomic<uint64_t> m_hits{ 0 };
+    std::atomic<uint64_t> m_misses{ 0 };
+    std::atomic<uint64_t> m_invalidations{ 0 };
+};
+
+extern DecodeCache g_DecodeCache;
@@ -11,6 +11,8 @@
 #include <stdint.h>
 #include <string>
 
+#include "TraceSource.h"
+
 // Custom formatter for TTD::GuestAddress to work with std::format
 template < typename CharT >
 struct std::formatter<TTD::GuestAddress, CharT> : std::formatter<uint64_t, CharT> {
@@ -65,6 +67,24 @@ struct std::formatter<TTD::Replay::Position, CharT> : std::formatter<std::basic_
     }
 };
 
+// Custom formatter for TracePosition, printed like the TTD::Replay::Position it stands for
+template < typename CharT >
+struct std::formatter<TracePosition, CharT> : std::formatter<std::basic_string<CharT>, CharT> {
+    template <typename FormatContext>
+    auto format(const TracePosition& pos, FormatContext& ctx) const {
+        if constexpr (std::is_same_v<CharT, wchar_t>)
+        {
+            return std::formatter<std::basic_string<CharT>, CharT>::format(
+                std::format(L"{:X}:{:X}", pos.sequence, pos.steps), ctx);
+        }
+        else
+        {
+            return std::formatter<std::basic_string<CharT>, CharT>::format(
+                std::format("{:X}:{:X}", pos.sequence, pos.steps), ctx);
+        }
+    }
+};
+
 // Custom formatter for TTD::Replay::PositionRange to work with std::format
 template < typename CharT >
 struct std::formatter<TTD::Replay::PositionRange, CharT> : std::formatter<std::basic_string<CharT>, CharT> {
@@ -0,0 +1,141 @@
+#include "LastWriterCache.h"
+
+void LastWriterCache::BindTo(const void* trace)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_trace != trace) {
+        m_entries.clear();
+        m_file = nullptr;
+        m_trace = trace;
+    }
+}
+
+void LastWriterCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_hits = 0;
+    m_misses = 0;
+    m_fileHits = 0;
+}
+
+void LastWriterCache::SetBackingFile(const IWriterCacheBacking* file)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_file = file;
+}
+
+void LastWriterCache::Export(std::vector<WriterCacheEntry>& entries)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto const& [key, intervals] : m_entries) {
+        if (intervals.noWriterUntil.IsValid()) {
+            entries.push_back(WriterCacheEntry::Make(key.location, key.size, key.thread, intervals.noWriterUntil, TracePosition()));
+        }
+        for (auto const& [writer, until] : intervals.writers) {
+            entries.push_back(WriterCacheEntry::Make(key.location, key.size, key.thread, until, writer));
+        }
+    }
+}
+
+// Register keys never collide with memory keys: a memory key has a non-zero size.
+LastWriterCache::Key LastWriterCache::RegisterKey(uint32_t thread, uint32_t reg, bool definitions)
+{
+    uint64_t location = ((uint64_t)thread << 17) | ((uint64_t)reg << 1) | (definitions ? 1 : 0);
+    return { location, 0, 0 };
+}
+
+bool LastWriterCache::FindRegisterWrite(uint32_t thread, uint32_t reg, bool definitions, TracePosition pos, TracePosition& writer)
+{
+    return Find(RegisterKey(thread, reg, definitions), pos, writer);
+}
+
+bool LastWriterCache::FindMemoryWrite(uint64_t address, uint64_t size, TracePosition pos, TracePosition& writer, const uint32_t* onlyThread)
+{
+    if (size == 0) return false;
+    // A search over all threads also answers one restricted to a single thread.
+    if (onlyThread && Find(MemoryKey(address, size, onlyThread), pos, writer)) return true;
+    return Find(MemoryKey(address, size, nullptr), pos, writer);
+}
+
+void LastWriterCache::AddRegisterWrite(uint32_t thread, uint32_t reg, bool definitions, TracePosition pos, TracePosition writer)
+{
+    Add(RegisterKey(thread, reg, definitions), pos, writer);
+}
+
+void LastWriterCache::AddMemoryWrite(uint64_t address, uint64_t size, TracePosition pos, TracePosition writer, const uint32_t* onlyThread)
+{
+    if (size == 0) return;
+    Add(MemoryKey(address, size, onlyThread), pos, writer);
+}
+
+bool LastWriterCache::Find(Key const& key, TracePosition pos, TracePosition& writer)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        Intervals& intervals = it->second;
+
+        if (intervals.noWriterUntil.IsValid() && pos <= intervals.noWriterUntil) {
+            writer = TracePosition();
+            m_hits++;
+            return true;
+        }
+
+        // The newest writer strictly before pos, if its interval reaches pos.
+        auto older = intervals.writers.lower_bound(pos);
+        if (older != intervals.writers.begin()) {
+            --older;
+            if (pos <= older->second) {
+                writer = older->first;
+                m_hits++;
+                return true;
+            }
+        }
+    }
+
+    if (m_file && m_file->Find(key.location, key.size, key.thread, pos, writer)) {
+        m_fileHits++;
+        return true;
+    }
+
+    m_misses++;
+    return false;
+}
+
+void LastWriterCache::Add(Key const& key, TracePosition pos, TracePosition writer)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Intervals& intervals = m_entries[key];
+
+    if (!writer.IsValid()) {
+        if (!intervals.noWriterUntil.IsValid() || intervals.noWriterUntil < pos) {
+            intervals.noWriterUntil = pos;
+        }
+        return;
+    }
+
+    auto [it, inserted] = intervals.writers.try_emplace(writer, pos);
+    if (!inserted && it->second < pos) {
+        it->second = pos;
+    }
+}
+
+size_t LastWriterCache::GetLocationCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+size_t LastWriterCache::GetIntervalCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t count = 0;
+    for (auto const& [key, intervals] : m_entries) {
+        count += intervals.writers.size() + (intervals.noWriterUntil.IsValid() ? 1 : 0);
+    }
+    return count;
+}
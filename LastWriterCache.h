@@ -0,0 +1,114 @@
+// LastWriterCache.h
+//
+// Result cache for the write searches of _TimeTrack. A search that starts at position Q and finds
+// the write W also answers every later query for the same location at a position in (W, Q], so
+// each answer is stored as an interval and reused across branches and !timetrack invocations.
+// With a WriterCacheFile attached, misses fall back to the results saved by earlier sessions.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "TraceSource.h"
+
+// One search result: the last write of (location, size) before 'query' is 'writer'. It answers
+// every query position in (writer, query], or every position up to 'query' when there is no writer.
+// This is also the record format of WriterCacheFile.
+struct WriterCacheEntry {
+    uint64_t location;
+    uint64_t size;
+    uint64_t thread;         // LastWriterCache key: 0, or the id + 1 of the only thread searched
+    uint64_t querySequence;
+    uint64_t querySteps;
+    uint64_t writerSequence; // c_noWriter when the location is not written before the query
+    uint64_t writerSteps;
+
+    static constexpr uint64_t c_noWriter = UINT64_MAX;
+
+    static WriterCacheEntry Make(uint64_t location, uint64_t size, uint64_t thread, TracePosition query, TracePosition writer) {
+        WriterCacheEntry entry = { location, size, thread, query.sequence, query.steps, c_noWriter, c_noWriter };
+        if (writer.IsValid()) {
+            entry.writerSequence = writer.sequence;
+            entry.writerSteps = writer.steps;
+        }
+        return entry;
+    }
+};
+
+// Read-only results of earlier sessions (WriterCacheFile).
+class IWriterCacheBacking {
+public:
+    virtual ~IWriterCacheBacking() = default;
+
+    // True when an entry answers 'pos'; 'writer' is invalid for "no write".
+    virtual bool Find(uint64_t location, uint64_t size, uint64_t thread, TracePosition pos, TracePosition& writer) const = 0;
+};
+
+class LastWriterCache {
+public:
+    // Drops every entry when 'trace' is not the trace the cache was filled from.
+    void BindTo(const void* trace);
+    void Clear();
+
+    // Read-only results of earlier sessions, consulted on a miss; nullptr detaches.
+    void SetBackingFile(const IWriterCacheBacking* file);
+
+    // Every cached interval, for saving to a WriterCacheFile.
+    void Export(std::vector<WriterCacheEntry>& entries);
+
+    // True on a hit; 'writer' is then the cached result, invalid when there is no write.
+    // 'definitions' separates results of definition searches (-exactdefs, -index) from value searches.
+    // 'onlyThread' separates memory searches that replayed a single thread from those over all threads.
+    bool FindRegisterWrite(uint32_t thread, uint32_t reg, bool definitions, TracePosition pos, TracePosition& writer);
+    bool FindMemoryWrite(uint64_t address, uint64_t size, TracePosition pos, TracePosition& writer, const uint32_t* onlyThread = nullptr);
+
+    // Records that the last write before 'pos' is 'writer' (invalid for none).
+    void AddRegisterWrite(uint32_t thread, uint32_t reg, bool definitions, TracePosition pos, TracePosition writer);
+    void AddMemoryWrite(uint64_t address, uint64_t size, TracePosition pos, TracePosition writer, const uint32_t* onlyThread = nullptr);
+
+    uint64_t GetHits() const { return m_hits; }
+    uint64_t GetMisses() const { return m_misses; }
+    uint64_t GetFileHits() const { return m_fileHits; }
+    size_t GetLocationCount();
+    size_t GetIntervalCount();
+
+private:
+    struct Key {
+        uint64_t location;
+        uint64_t size;
+        uint64_t thread; // memory searches of a single thread: its id + 1, otherwise 0
+        bool operator==(Key const& other) const { return location == other.location && size == other.size && thread == other.thread; }
+    };
+
+    struct KeyHash {
+        size_t operator()(Key const& key) const {
+            return std::hash<uint64_t>()(key.location) ^ (std::hash<uint64_t>()(key.size) * 0x9E3779B97F4A7C15ull) ^ (key.thread << 48);
+        }
+    };
+
+    struct Intervals {
+        std::map<TracePosition, TracePosition> writers; // writer -> furthest query position it answers
+        TracePosition noWriterUntil;                    // nothing is written before this position
+    };
+
+    static Key RegisterKey(uint32_t thread, uint32_t reg, bool definitions);
+    static Key MemoryKey(uint64_t address, uint64_t size, const uint32_t* onlyThread) {
+        return { address, size, onlyThread ? (uint64_t)*onlyThread + 1 : 0 };
+    }
+
+    bool Find(Key const& key, TracePosition pos, TracePosition& writer);
+    void Add(Key const& key, TracePosition pos, TracePosition writer);
+
+    std::mutex m_mutex;
+    std::unordered_map<Key, Intervals, KeyHash> m_entries;
+    const void* m_trace = nullptr;
+    const IWriterCacheBacking* m_file = nullptr;
+
+    std::atomic<uint64_t> m_hits{ 0 };
+    std::atomic<uint64_t> m_misses{ 0 };
+    std::atomic<uint64_t> m_fileHits{ 0 };
+};
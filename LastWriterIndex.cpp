@@ -0,0 +1,121 @@
+#include "LastWriterIndex.h"
+
+#include <algorithm>
+
+#include "TrackStats.h"
+
+bool LastWriterIndex::Build(ITraceSource& source, TracePosition start, uint64_t windowSteps)
+{
+    m_registerWrites.clear();
+    m_memoryWrites.clear();
+    m_registerWriteCount = 0;
+    m_memoryWriteCount = 0;
+    m_isFull = false;
+    m_isBuilt = false;
+
+    TracePosition windowStart;
+    bool reachedStart;
+    {
+        ScopedPhaseTimer timer(TrackPhase::Replay);
+        reachedStart = source.CollectWrites(start, windowSteps, *this, windowStart);
+    }
+    if (!windowStart.IsValid()) {
+        return false;
+    }
+
+    m_windowStart = windowStart;
+    m_windowEnd = start;
+    m_reachesTraceStart = !m_isFull && reachedStart;
+
+    // Multi-threaded replay does not hand out positions in strict order.
+    auto newestFirst = [](TracePosition const& a, TracePosition const& b) { return b < a; };
+    for (auto& [key, writes] : m_registerWrites) {
+        std::sort(writes.begin(), writes.end(), [&](RegisterWrite const& a, RegisterWrite const& b) { return newestFirst(a.pos, b.pos); });
+        writes.erase(std::unique(writes.begin(), writes.end(), [](RegisterWrite const& a, RegisterWrite const& b) {
+            return a.pos == b.pos && a.bytes == b.bytes;
+        }), writes.end());
+    }
+    for (auto& [granule, writes] : m_memoryWrites) {
+        std::sort(writes.begin(), writes.end(), [&](MemoryWrite const& a, MemoryWrite const& b) { return newestFirst(a.pos, b.pos); });
+    }
+
+    m_isBuilt = true;
+    return true;
+}
+
+// Stopping here leaves the writes of older steps out, so every recorded write is still the
+// newest one of its location and the window simply starts at this step.
+bool LastWriterIndex::IsAtLimit()
+{
+    if (m_registerWriteCount + m_memoryWriteCount >= c_maxWrites) {
+        m_isFull = true;
+    }
+    return m_isFull;
+}
+
+bool LastWriterIndex::AddRegisterWrite(uint32_t thread, uint32_t reg, uint16_t bytes, TracePosition pos)
+{
+    if (IsAtLimit()) return false;
+
+    m_registerWrites[RegisterKey(thread, reg)].push_back({ pos, bytes });
+    m_registerWriteCount++;
+    return true;
+}
+
+bool LastWriterIndex::AddMemoryWrite(uint64_t address, uint64_t size, TracePosition pos)
+{
+    if (IsAtLimit()) return false;
+    if (size == 0) return true;
+
+    uint64_t first = address >> c_granuleShift;
+    uint64_t last = (address + size - 1) >> c_granuleShift;
+    for (uint64_t granule = first; granule <= last; granule++) {
+        m_memoryWrites[granule].push_back({ pos, address, size });
+    }
+    m_memoryWriteCount++;
+    return true;
+}
+
+TracePosition LastWriterIndex::FindRegisterWrite(uint32_t thread, TrackedRegister reg, TracePosition pos) const
+{
+    auto it = m_registerWrites.find(RegisterKey(thread, reg.reg));
+    if (it == m_registerWrites.end()) {
+        return TracePosition();
+    }
+
+    // Writes that leave the bytes of 'reg' alone (ah while tracking al) are skipped.
+    const auto& writes = it->second;
+    auto older = std::partition_point(writes.begin(), writes.end(), [&](RegisterWrite const& w) { return !(w.pos < pos); });
+    for (; older != writes.end(); ++older) {
+        if (older->bytes & reg.bytes) return older->pos;
+    }
+    return TracePosition();
+}
+
+TracePosition LastWriterIndex::FindMemoryWrite(uint64_t address, uint64_t size, TracePosition pos) const
+{
+    if (size == 0) return TracePosition();
+
+    TracePosition best;
+
+    uint64_t first = address >> c_granuleShift;
+    uint64_t last = (address + size - 1) >> c_granuleShift;
+    for (uint64_t granule = first; granule <= last; granule++) {
+        auto it = m_memoryWrites.find(granule);
+        if (it == m_memoryWrites.end()) continue;
+
+        const auto& writes = it->second;
+        auto older = std::partition_point(writes.begin(), writes.end(), [&](MemoryWrite const& w) { return !(w.pos < pos); });
+
+        for (; older != writes.end(); ++older) {
+            if (older->address < address + size && address < older->address + older->size) {
+                if (!best.IsValid() || best < older->pos) {
+                    best = older->pos;
+                }
+                break;
+            }
+        }
+    }
+
+    return best;
+}
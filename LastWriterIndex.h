@@ -0,0 +1,77 @@
+// LastWriterIndex.h
+//
+// Single-pass "last writer" index for _TimeTrack. The window in front of the tracking
+// start is replayed backward once and every register and memory write seen on the way is
+// recorded, so each work item becomes a lookup instead of its own ReplayBackward.
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "TraceSource.h"
+
+class LastWriterIndex : public ITraceWriteSink {
+public:
+    // Collects the writes of 'source' backward from 'start'. windowSteps == 0 goes to the start of the trace.
+    // The collection also stops once c_maxWrites writes are recorded; the window then starts where it
+    // stopped and ReachesTraceStart() is false.
+    bool Build(ITraceSource& source, TracePosition start, uint64_t windowSteps);
+
+    // About 1 GB of index at the worst case of one 8-byte granule per write.
+    static constexpr size_t c_maxWrites = (size_t)1 << 24;
+
+    // Position of the last write strictly before 'pos', invalid when the location is not written
+    // inside the window. Positions follow ITraceSource::FindRegisterWrite and FindMemoryWrite.
+    TracePosition FindRegisterWrite(uint32_t thread, TrackedRegister reg, TracePosition pos) const;
+    TracePosition FindMemoryWrite(uint64_t address, uint64_t size, TracePosition pos) const;
+
+    bool IsBuilt() const { return m_isBuilt; }
+    bool Covers(TracePosition pos) const { return m_isBuilt && m_windowStart <= pos && pos <= m_windowEnd; }
+
+    // False when the window stops short of the trace start, i.e. a miss is not final.
+    bool ReachesTraceStart() const { return m_reachesTraceStart; }
+    bool IsFull() const { return m_isFull; }
+    TracePosition GetWindowStart() const { return m_windowStart; }
+
+    size_t GetRegisterWriteCount() const { return m_registerWriteCount; }
+    size_t GetMemoryWriteCount() const { return m_memoryWriteCount; }
+
+    // ITraceWriteSink; false once c_maxWrites writes are recorded.
+    bool AddRegisterWrite(uint32_t thread, uint32_t reg, uint16_t bytes, TracePosition pos) override;
+    bool AddMemoryWrite(uint64_t address, uint64_t size, TracePosition pos) override;
+
+private:
+    struct RegisterWrite {
+        TracePosition pos;
+        uint16_t bytes;     // bytes of the tracked register written, see TrackedRegister
+    };
+
+    struct MemoryWrite {
+        TracePosition pos;
+        uint64_t address;
+        uint64_t size;
+    };
+
+    // Memory writes are bucketed by 8-byte granule so a lookup only visits the granules it overlaps.
+    static constexpr unsigned c_granuleShift = 3;
+
+    static uint64_t RegisterKey(uint32_t thread, uint32_t reg) {
+        return ((uint64_t)thread << 16) | (uint64_t)reg;
+    }
+
+    bool IsAtLimit();
+
+    // Both sorted newest first.
+    std::unordered_map<uint64_t, std::vector<RegisterWrite>> m_registerWrites;
+    std::unordered_map<uint64_t, std::vector<MemoryWrite>> m_memoryWrites;
+
+    TracePosition m_windowStart;
+    TracePosition m_windowEnd;
+    bool m_reachesTraceStart = false;
+    bool m_isFull = false;
+    bool m_isBuilt = false;
+
+    size_t m_registerWriteCount = 0;
+    size_t m_memoryWriteCount = 0;
+};
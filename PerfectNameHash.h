@@ -0,0 +1,125 @@
+// PerfectNameHash.h
+//
+// Two-level perfect hash over a fixed list of lowercase ASCII names (hash and displace): the
+// FNV-1a hash of the name picks a bucket, the bucket's seed places every name of the bucket in
+// its own slot. Built at compile time; a lookup is one hash, two table reads and one compare,
+// case-insensitive, with no allocation and no lazily built state, so it is safe from any thread.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+template <size_t Count, size_t Buckets, size_t Slots>
+class PerfectNameHash {
+public:
+    // 'entries' is the list the table indexes, e.g. name -> register id; only the names are kept.
+    // A bucket may hold at most 16 names, which Slots of a few times Count easily gives.
+    template <typename T>
+    consteval explicit PerfectNameHash(const std::pair<std::string_view, T> (&entries)[Count]) {
+        for (size_t i = 0; i < Count; i++) m_names[i] = entries[i].first;
+        Place();
+    }
+
+    consteval explicit PerfectNameHash(const std::string_view (&names)[Count]) {
+        for (size_t i = 0; i < Count; i++) m_names[i] = names[i];
+        Place();
+    }
+
+    // Index of 'name' in the entries, -1 when it is not one of them.
+    constexpr int Find(std::string_view name) const {
+        uint32_t hash = Hash(name);
+        int16_t index = m_slots[Slot(hash, m_seeds[hash % Buckets])];
+        if (index < 0) return -1;
+
+        std::string_view candidate = m_names[index];
+        if (candidate.size() != name.size()) return -1;
+
+        for (size_t i = 0; i < name.size(); i++) {
+            if (ToLowerAscii(name[i]) != candidate[i]) return -1;
+        }
+        return index;
+    }
+
+private:
+    consteval void Place() {
+        m_slots.fill(-1);
+
+        std::array<uint32_t, Count> hashes{};
+        std::array<size_t, Buckets + 1> bucketStart{};
+        for (size_t i = 0; i < Count; i++) {
+            hashes[i] = Hash(m_names[i]);
+            bucketStart[hashes[i] % Buckets + 1]++;
+        }
+
+        size_t largestBucket = 0;
+        for (size_t b = 0; b < Buckets; b++) {
+            largestBucket = std::max(largestBucket, bucketStart[b + 1]);
+            bucketStart[b + 1] += bucketStart[b];
+        }
+
+        // Names grouped by bucket.
+        std::array<size_t, Count> members{};
+        std::array<size_t, Buckets> fill{};
+        for (size_t i = 0; i < Count; i++) {
+            size_t b = hashes[i] % Buckets;
+            members[bucketStart[b] + fill[b]++] = i;
+        }
+
+        // Largest buckets first, while most slots are still free.
+        for (size_t size = largestBucket; size > 0; size--) {
+            for (size_t b = 0; b < Buckets; b++) {
+                if (bucketStart[b + 1] - bucketStart[b] != size) continue;
+
+                for (uint32_t seed = 1;; seed++) {
+                    std::array<size_t, 16> placed{};
+                    bool fits = size <= placed.size();
+
+                    for (size_t m = 0; fits && m < size; m++) {
+                        size_t slot = Slot(hashes[members[bucketStart[b] + m]], seed);
+                        fits = m_slots[slot] < 0;
+                        for (size_t other = 0; fits && other < m; other++) {
+                            fits = placed[other] != slot;
+                        }
+                        placed[m] = slot;
+                    }
+
+                    if (fits) {
+                        for (size_t m = 0; m < size; m++) {
+                            m_slots[placed[m]] = (int16_t)members[bucketStart[b] + m];
+                        }
+                        m_seeds[b] = (uint16_t)seed;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    static constexpr char ToLowerAscii(char c) {
+        return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+    }
+
+    static constexpr uint32_t Hash(std::string_view name) {
+        uint32_t hash = 2166136261u;
+        for (char c : name) {
+            hash = (hash ^ (uint8_t)ToLowerAscii(c)) * 16777619u;
+        }
+        return hash;
+    }
+
+    static constexpr size_t Slot(uint32_t hash, uint32_t seed) {
+        uint32_t x = hash ^ (seed * 0x9E3779B9u);
+        x ^= x >> 16;
+        x *= 0x85EBCA6Bu;
+        x ^= x >> 13;
+        return x % Slots;
+    }
+
+    std::array<std::string_view, Count> m_names{};
+    std::array<uint16_t, Buckets> m_seeds{};
+    std::array<int16_t, Slots> m_slots{};
+};
@@ -76,6 +76,15 @@ constexpr bool IsAliasedRegister(ContextPosition const& position)
         RegisterNameFlags::Alias \
     }}
 
+// Creates a register entry for a register stored inside a larger context
+// field, such as the xmm registers in the FXSAVE area of X86_NT5_CONTEXT.
+#define REG_TO_CONTEXT_SPAN_EMBEDDED(name, field, size, offset) std::pair { \
+    std::wstring_view{name}, \
+    ContextPosition { \
+        offsetof(Context, field) + offset, \
+        size, \
+    }}
+
 // Table mapping x86 register names to ContextPositions, sorted
 // lexicographically by register name.
 constexpr auto c_x86RegisterNameToContextSpan = []() consteval
@@ -89,9 +98,9 @@ constexpr auto c_x86RegisterNameToContextSpan = []() consteval
         REG_TO_CONTEXT_SPAN_SIZE( L"ax", Eax, 2),
         REG_TO_CONTEXT_SPAN     (L"eax", Eax),
 
-        REG_TO_CONTEXT_SPAN_SIZE(L" bl", Ebx, 1),
-        REG_TO_CONTEXT_SPAN_OFFSET(L" bh", Ebx, 1, 1),
-        REG_TO_CONTEXT_SPAN_SIZE(L" bx", Ebx, 2),
+        REG_TO_CONTEXT_SPAN_SIZE( L"bl", Ebx, 1),
+        REG_TO_CONTEXT_SPAN_OFFSET( L"bh", Ebx, 1, 1),
+        REG_TO_CONTEXT_SPAN_SIZE( L"bx", Ebx, 2),
         REG_TO_CONTEXT_SPAN     (L"ebx", Ebx),
 
         REG_TO_CONTEXT_SPAN_SIZE( L"cl", Ecx, 1),
@@ -121,6 +130,25 @@ constexpr auto c_x86RegisterNameToContextSpan = []() consteval
         REG_TO_CONTEXT_SPAN     (L"esp", Esp),
 
         REG_TO_CONTEXT_SPAN     (L"eip", Eip),
+        REG_TO_CONTEXT_SPAN  (L"eflags", EFlags),
+
+        // The selectors are the low word of their 32-bit context fields.
+        REG_TO_CONTEXT_SPAN_EMBEDDED(L"cs", SegCs, 2, 0),
+        REG_TO_CONTEXT_SPAN_EMBEDDED(L"ds", SegDs, 2, 0),
+        REG_TO_CONTEXT_SPAN_EMBEDDED(L"es", SegEs, 2, 0),
+        REG_TO_CONTEXT_SPAN_EMBEDDED(L"fs", SegFs, 2, 0),
+        REG_TO_CONTEXT_SPAN_EMBEDDED(L"gs", SegGs, 2, 0),
+        REG_TO_CONTEXT_SPAN_EMBEDDED(L"ss", SegSs, 2, 0),
+
+        // ExtendedRegisters holds the FXSAVE image; xmm0-7 start at byte 160.
+        REG_TO_CONTEXT_SPAN_EMBEDDED(L"xmm0", ExtendedRegisters, 16, 160 + 0 * 16),
+        REG_TO_CONTEXT_SPAN_EMBEDDED(L"xmm1", ExtendedRegisters, 16, 160 + 1 * 16),
+        REG_TO_CONTEXT_SPAN_EMBEDDED(L"xmm2", ExtendedRegisters, 16, 160 + 2 * 16),
+        REG_TO_CONTEXT_SPAN_EMBEDDED(L"xmm3", ExtendedRegisters, 16, 160 + 3 * 16),
+        REG_TO_CONTEXT_SPAN_EMBEDDED(L"xmm4", ExtendedRegisters, 16, 160 + 4 * 16),
+        REG_TO_CONTEXT_SPAN_EMBEDDED(L"xmm5", ExtendedRegisters, 16, 160 + 5 * 16),
+        REG_TO_CONTEXT_SPAN_EMBEDDED(L"xmm6", ExtendedRegisters, 16, 160 + 6 * 16),
+        REG_TO_CONTEXT_SPAN_EMBEDDED(L"xmm7", ExtendedRegisters, 16, 160 + 7 * 16),
 
         // More esoteric but potentially useful registers
         REG_TO_CONTEXT_SPAN(L"contextflags", ContextFlags),
@@ -236,12 +264,20 @@ constexpr auto c_x64RegisterNameToContextSpan = []() consteval
         REG_TO_CONTEXT_SPAN     (L"xmm14", Xmm14),
         REG_TO_CONTEXT_SPAN     (L"xmm15", Xmm15),
 
-        // TODO: Vector registers
+        // The upper ymm/zmm lanes are not part of CROSS_PLATFORM_CONTEXT; vector
+        // registers are tracked through their xmm lane (GetVectorLaneRegister).
 
         // More esoteric but potentially useful registers
         REG_TO_CONTEXT_SPAN(      L"eflags", EFlags),
         REG_TO_CONTEXT_SPAN(L"contextflags", ContextFlags),
         REG_TO_CONTEXT_SPAN(       L"mxcsr", MxCsr),
+
+        REG_TO_CONTEXT_SPAN(          L"cs", SegCs),
+        REG_TO_CONTEXT_SPAN(          L"ds", SegDs),
+        REG_TO_CONTEXT_SPAN(          L"es", SegEs),
+        REG_TO_CONTEXT_SPAN(          L"fs", SegFs),
+        REG_TO_CONTEXT_SPAN(          L"gs", SegGs),
+        REG_TO_CONTEXT_SPAN(          L"ss", SegSs),
     };
 
     std::ranges::sort(result, [](auto const& lhs, auto const& rhs)
@@ -0,0 +1,648 @@
+#include "ReplayTraceSource.h"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <unordered_map>
+
+#include <TTD/IReplayEngineStl.h>
+
+#include "DecodeCache.h"
+#include "ReplayHelpers.h"
+#include "TrackBudget.h"
+#include "TrackStats.h"
+
+extern ProcessorArchitecture g_TargetCPUType;
+extern DecodeCache g_DecodeCache;
+
+static const ZydisRegister c_x64GeneralRegisters[] = {
+    ZYDIS_REGISTER_RAX, ZYDIS_REGISTER_RCX, ZYDIS_REGISTER_RDX, ZYDIS_REGISTER_RBX,
+    ZYDIS_REGISTER_RSP, ZYDIS_REGISTER_RBP, ZYDIS_REGISTER_RSI, ZYDIS_REGISTER_RDI,
+    ZYDIS_REGISTER_R8,  ZYDIS_REGISTER_R9,  ZYDIS_REGISTER_R10, ZYDIS_REGISTER_R11,
+    ZYDIS_REGISTER_R12, ZYDIS_REGISTER_R13, ZYDIS_REGISTER_R14, ZYDIS_REGISTER_R15,
+    ZYDIS_REGISTER_XMM0,  ZYDIS_REGISTER_XMM1,  ZYDIS_REGISTER_XMM2,  ZYDIS_REGISTER_XMM3,
+    ZYDIS_REGISTER_XMM4,  ZYDIS_REGISTER_XMM5,  ZYDIS_REGISTER_XMM6,  ZYDIS_REGISTER_XMM7,
+    ZYDIS_REGISTER_XMM8,  ZYDIS_REGISTER_XMM9,  ZYDIS_REGISTER_XMM10, ZYDIS_REGISTER_XMM11,
+    ZYDIS_REGISTER_XMM12, ZYDIS_REGISTER_XMM13, ZYDIS_REGISTER_XMM14, ZYDIS_REGISTER_XMM15,
+};
+
+static const ZydisRegister c_x86GeneralRegisters[] = {
+    ZYDIS_REGISTER_EAX, ZYDIS_REGISTER_ECX, ZYDIS_REGISTER_EDX, ZYDIS_REGISTER_EBX,
+    ZYDIS_REGISTER_ESP, ZYDIS_REGISTER_EBP, ZYDIS_REGISTER_ESI, ZYDIS_REGISTER_EDI,
+    ZYDIS_REGISTER_XMM0, ZYDIS_REGISTER_XMM1, ZYDIS_REGISTER_XMM2, ZYDIS_REGISTER_XMM3,
+    ZYDIS_REGISTER_XMM4, ZYDIS_REGISTER_XMM5, ZYDIS_REGISTER_XMM6, ZYDIS_REGISTER_XMM7,
+};
+
+// Counts one write search that replayed 'steps' steps.
+static void AddReplayStats(uint64_t steps)
+{
+    g_TrackStats.Add(TrackCounter::ReplaySteps, steps);
+    g_TrackStats.AddReplayDistance(steps);
+}
+
+// ReplayBackward(limit) split into step-count chunks so the budget is enforced between chunks
+// and, through the replay progress callback, within them. Returns the stop reason of the last
+// chunk; EventType::Interrupted when the budget ran out. The replay never goes past the query
+// window, a query that reaches its end is marked outside the window.
+static EventType ReplayBackwardWithBudget(ICursor* cursor, Position const& limit, QueryBudget* budget)
+{
+    ScopedPhaseTimer timer(TrackPhase::Replay);
+
+    if (!budget) {
+        ICursor::ReplayResult result = cursor->ReplayBackward(limit);
+        AddReplayStats((uint64_t)result.StepCount);
+        return result.StopReason;
+    }
+
+    PositionRange lifetime = cursor->GetReplayEngine()->GetLifetime();
+    TrackBudget& track = budget->GetTrack();
+
+    // Same hook FilteredWatchpointQuery uses for its Progress callback.
+    auto const replayProgress = [&](Position const& position) {
+        track.ReportProgress(GetProgressPercent(position, lifetime));
+        if (budget->ShouldInterrupt()) {
+            cursor->InterruptReplay();
+        }
+    };
+    cursor->SetReplayProgressCallback(replayProgress);
+
+    EventType stopReason = EventType::Interrupted;
+    uint64_t replayed = 0;
+
+    Position windowLimit = limit;
+    Position windowStart = ReplayTraceSource::ToPosition(budget->GetWindowStart());
+    if (windowLimit < windowStart) {
+        windowLimit = windowStart;
+    }
+
+    for (;;) {
+        if (budget->IsWindowFull()) {
+            budget->MarkOutsideWindow();
+            stopReason = EventType::Position;
+            break;
+        }
+
+        uint64_t chunk = budget->NextChunk();
+        if (chunk == 0 || budget->ShouldInterrupt()) {
+            budget->MarkExhausted();
+            stopReason = EventType::Interrupted;
+            break;
+        }
+
+        Position previousPosition = cursor->GetPosition();
+        ICursor::ReplayResult result = cursor->ReplayBackward(windowLimit, StepCount{ chunk });
+        stopReason = result.StopReason;
+        replayed += (uint64_t)result.StepCount;
+
+        // Every chunk counts, whatever stopped it: most searches end on their watchpoint within the first one.
+        budget->AddSteps((uint64_t)result.StepCount);
+
+        if (stopReason == EventType::StepCount) {
+            if (cursor->GetPosition() == previousPosition) break;
+            continue;
+        }
+
+        if (stopReason == EventType::Interrupted) {
+            budget->MarkExhausted();
+        }
+        else if (stopReason == EventType::Position && limit < windowLimit) {
+            budget->MarkOutsideWindow();
+        }
+        break;
+    }
+
+    cursor->SetReplayProgressCallback(nullptr, 0);
+    budget->SetStopPosition(ReplayTraceSource::FromPosition(cursor->GetPosition()));
+    AddReplayStats(replayed);
+    return stopReason;
+}
+
+ReplayTraceSource::ReplayTraceSource(ICursor* cursor, StackClassifier& stacks)
+    : m_cursor(cursor), m_stacks(stacks), m_decoded(g_TargetCPUType)
+{
+}
+
+Position ReplayTraceSource::ToPosition(TracePosition pos)
+{
+    if (!pos.IsValid()) return Position::Invalid;
+
+    Position result;
+    result.Sequence = static_cast<SequenceId>(pos.sequence);
+    result.Steps = static_cast<StepCount>(pos.steps);
+    return result;
+}
+
+TracePosition ReplayTraceSource::FromPosition(Position const& pos)
+{
+    if (pos == Position::Invalid) return {};
+    return { static_cast<uint64_t>(pos.Sequence), static_cast<uint64_t>(pos.Steps) };
+}
+
+void ReplayTraceSource::MoveTo(TracePosition pos)
+{
+    Position target = ToPosition(pos);
+    if (m_cursor->GetPosition() != target) {
+        m_cursor->SetPosition(target);
+    }
+}
+
+// The watchpoint still fires for every instruction replayed backward, but each PC is decoded once
+// and the register is only read for instructions that write the target (or whose writes are unknown).
+// With stopAtDefinition the search ends at the first instruction that unconditionally writes every
+// byte of the register, even if it stores the value the register already had.
+TracePosition ReplayTraceSource::FindRegisterWrite(uint32_t reg, TracePosition pos, bool stopAtDefinition, QueryBudget* budget)
+{
+    struct __TargetReg {
+        ZydisRegister reg = ZYDIS_REGISTER_NONE;
+        ZydisRegister enclosingReg = ZYDIS_REGISTER_NONE;
+        uint16_t bytes = 0;
+        RegValue value = 0;
+        bool stopAtDefinition = false;
+        WrittenRegisterCache* decoded = nullptr;
+        RegisterReader* registers = nullptr;
+    };
+
+    MoveTo(pos);
+
+    RegisterReader registers;
+
+    __TargetReg targetReg;
+    targetReg.reg = (ZydisRegister)reg;
+    targetReg.enclosingReg = ::GetTrackedRegister(m_decoded.GetMachineMode(), targetReg.reg);
+    targetReg.bytes = GetRegisterBytes(m_decoded.GetMachineMode(), targetReg.reg);
+    targetReg.stopAtDefinition = stopAtDefinition;
+    targetReg.decoded = &m_decoded;
+    targetReg.registers = &registers;
+
+    try {
+        targetReg.value = registers.Read(m_cursor, targetReg.reg);
+    }
+    catch (...) {
+        return {};
+    }
+
+    auto _MemoryWatchpointCallback = [](uintptr_t targetPtr, ICursor::MemoryWatchpointResult const&, IThreadView const* thread) {
+        __TargetReg& target = *(__TargetReg*)targetPtr;
+
+        const RegisterWriteSet& writes = target.decoded->Get(thread);
+        if (!writes.opaque && !writes.Contains(target.enclosingReg)) {
+            return false;
+        }
+
+        if (target.stopAtDefinition && writes.AlwaysWrites(target.enclosingReg, target.bytes)) {
+            return true;
+        }
+
+        RegValue val;
+
+        try
+        {
+            val = target.registers->Read(thread, target.reg);
+        }
+        catch (...)
+        {
+            return false;
+        }
+
+        if (val != target.value) {
+            return true;
+        }
+
+        return false;
+    };
+
+    MemoryWatchpointData wd = { GuestAddress::Min, (uint64_t)GuestAddress::Max, DataAccessMask::Execute };
+
+    m_cursor->AddMemoryWatchpoint(wd);
+    m_cursor->SetEventMask(EventMask::MemoryWatchpoint);
+    m_cursor->SetReplayFlags(ReplayFlags::ReplayOnlyCurrentThread | ReplayFlags::ReplaySegmentsSequentially);
+    m_cursor->SetMemoryWatchpointCallback(_MemoryWatchpointCallback, (uintptr_t)&targetReg);
+
+    EventType stopReason = ReplayBackwardWithBudget(m_cursor, Position::Min, budget);
+
+    m_cursor->RemoveMemoryWatchpoint(wd);
+    m_cursor->SetMemoryWatchpointCallback(nullptr, 0);
+
+    if (stopReason == EventType::MemoryWatchpoint) {
+        return FromPosition(m_cursor->GetPosition());
+    }
+
+    return {};
+}
+
+TracePosition ReplayTraceSource::FindMemoryWrite(uint64_t address, uint64_t size, TracePosition pos, QueryBudget* budget, bool currentThreadOnly)
+{
+    MoveTo(pos);
+
+    MemoryWatchpointData wd = { (GuestAddress)address, size, DataAccessMask::Write };
+
+    m_cursor->AddMemoryWatchpoint(wd);
+    m_cursor->SetEventMask(EventMask::MemoryWatchpoint);
+    m_cursor->SetReplayFlags(currentThreadOnly ? ReplayFlags::ReplayOnlyCurrentThread | ReplayFlags::ReplaySegmentsSequentially : ReplayFlags::None);
+
+    EventType stopReason = ReplayBackwardWithBudget(m_cursor, Position::Min, budget);
+
+    m_cursor->RemoveMemoryWatchpoint(wd);
+
+    if (stopReason == EventType::MemoryWatchpoint) {
+        // The replay stops after the writer.
+        Position writer = m_cursor->GetPosition() - 1;
+        m_cursor->SetPosition(writer);
+        if (budget) budget->SetStopPosition(FromPosition(writer));
+        return FromPosition(writer);
+    }
+
+    return {};
+}
+
+// The replay starts at the latest query position; a write is assigned to every query it
+// overlaps that starts after it, and the replay stops once every query has its write.
+void ReplayTraceSource::FindMemoryWrites(std::vector<MemoryWriteQuery>& queries, QueryBudget* budget, bool currentThreadOnly)
+{
+    struct BatchState {
+        std::vector<MemoryWriteQuery>* queries = nullptr;
+        size_t remaining = 0;
+    };
+
+    if (queries.empty()) return;
+
+    BatchState state;
+    state.queries = &queries;
+    state.remaining = queries.size();
+
+    TracePosition start = queries[0].pos;
+    std::set<std::pair<uint64_t, uint64_t>> ranges;
+    for (const MemoryWriteQuery& query : queries) {
+        if (start < query.pos) start = query.pos;
+        ranges.insert({ query.address, query.size });
+    }
+
+    auto _MemoryWatchpointCallback = [](uintptr_t statePtr, ICursor::MemoryWatchpointResult const& watchpoint, IThreadView const* thread) {
+        BatchState& state = *(BatchState*)statePtr;
+
+        uint64_t address = (uint64_t)watchpoint.Address;
+        TracePosition writer = FromPosition(thread->GetPosition() - 1);
+
+        for (MemoryWriteQuery& query : *state.queries) {
+            if (query.result.IsValid() || !(writer < query.pos)) continue;
+            if (address < query.address + query.size && query.address < address + watchpoint.Size) {
+                query.result = writer;
+                state.remaining--;
+            }
+        }
+
+        return state.remaining == 0;
+    };
+
+    MoveTo(start);
+
+    for (const auto& [address, size] : ranges) {
+        m_cursor->AddMemoryWatchpoint({ (GuestAddress)address, size, DataAccessMask::Write });
+    }
+    m_cursor->SetEventMask(EventMask::MemoryWatchpoint);
+    m_cursor->SetReplayFlags(currentThreadOnly ? ReplayFlags::ReplayOnlyCurrentThread | ReplayFlags::ReplaySegmentsSequentially : ReplayFlags::None);
+    m_cursor->SetMemoryWatchpointCallback(_MemoryWatchpointCallback, (uintptr_t)&state);
+
+    ReplayBackwardWithBudget(m_cursor, Position::Min, budget);
+
+    for (const auto& [address, size] : ranges) {
+        m_cursor->RemoveMemoryWatchpoint({ (GuestAddress)address, size, DataAccessMask::Write });
+    }
+    m_cursor->SetMemoryWatchpointCallback(nullptr, 0);
+}
+
+// Walks backward over the current thread, counting returns into callees so that only a call at
+// depth 0 ends the search.
+TracePosition ReplayTraceSource::FindFrameEntry(TracePosition pos, QueryBudget* budget)
+{
+    struct FrameEntrySearch {
+        ZydisDecoder decoder;
+        std::unordered_map<uint64_t, ZydisMnemonic> mnemonics;
+        int depth = 0;
+        Position entry = Position::Invalid;
+        QueryBudget* budget = nullptr;
+
+        ZydisMnemonic GetMnemonic(IThreadView const* thread) {
+            uint64_t pc = (uint64_t)thread->GetProgramCounter();
+            auto it = mnemonics.find(pc);
+            if (it != mnemonics.end()) return it->second;
+
+            uint8_t buffer[16];
+            BufferView bufferView{ buffer, sizeof(buffer) };
+            thread->QueryMemoryBuffer((GuestAddress)pc, bufferView);
+
+            ZydisDecodedInstruction instruction;
+            ZydisMnemonic mnemonic = ZYDIS_MNEMONIC_INVALID;
+            if (ZYAN_SUCCESS(ZydisDecoderDecodeInstruction(&decoder, ZYAN_NULL, buffer, sizeof(buffer), &instruction))) {
+                mnemonic = instruction.mnemonic;
+            }
+            return mnemonics[pc] = mnemonic;
+        }
+
+        bool operator()(ICursorView::MemoryWatchpointResult const&, IThreadView const* thread) {
+            ZydisMnemonic mnemonic = GetMnemonic(thread);
+
+            if (mnemonic == ZYDIS_MNEMONIC_RET) {
+                depth++;
+            }
+            else if (mnemonic == ZYDIS_MNEMONIC_CALL) {
+                if (depth == 0) {
+                    entry = thread->GetPosition();
+                    return true;
+                }
+                depth--;
+            }
+            return false;
+        }
+
+        bool Progress(Position const&, double) {
+            return budget && budget->ShouldInterrupt();
+        }
+    };
+
+    MoveTo(pos);
+
+    FrameEntrySearch search;
+    SetupZydisDecoder(&search.decoder, g_TargetCPUType);
+    search.budget = budget;
+
+    MemoryWatchpointData wd = { GuestAddress::Min, (uint64_t)GuestAddress::Max, DataAccessMask::Execute };
+
+    m_cursor->AddMemoryWatchpoint(wd);
+    m_cursor->SetReplayFlags(ReplayFlags::ReplayOnlyCurrentThread | ReplayFlags::ReplaySegmentsSequentially);
+
+    FilteredWatchpointQuery(*m_cursor, GetReplayRange(*m_cursor, ReplayDirection::Backward), ReplayDirection::Backward, search);
+
+    m_cursor->RemoveMemoryWatchpoint(wd);
+
+    return FromPosition(search.entry);
+}
+
+// Appends the locations the instruction at the cursor reads to compute what it writes: the base
+// and index of an LEA, otherwise every register and memory operand it reads, flags excepted.
+static void CollectReadLocations(ICursor* cursor, const DecodedInstruction& decoded, std::vector<TraceLocation>& reads)
+{
+    RegisterReader registers;
+
+    const ZydisDecodedInstruction& instruction = decoded.instruction;
+    const ZydisDecodedOperand* operands = decoded.operands;
+
+    auto AddRead = [&](const ZydisDecodedOperand& op) {
+        if (op.type == ZYDIS_OPERAND_TYPE_MEMORY) {
+            uint64_t base = op.mem.base == ZYDIS_REGISTER_NONE ? 0 : (uint64_t)registers.Read(cursor, op.mem.base, false);
+            uint64_t index = op.mem.index == ZYDIS_REGISTER_NONE ? 0 : (uint64_t)registers.Read(cursor, op.mem.index, false);
+            uint64_t scale = (op.mem.scale == 0) ? 1 : op.mem.scale;
+
+            uint32_t size = op.size / 8;
+            if (size == 0) size = 8;
+            reads.push_back(TraceLocation::Memory(base + (index * scale) + op.mem.disp.value, size));
+        }
+        else if (op.type == ZYDIS_OPERAND_TYPE_REGISTER) {
+            ZydisRegister reg = GetTrackedRegister(ZYDIS_MACHINE_MODE_LONG_64, op.reg.value);
+            reads.push_back(TraceLocation::Register(reg, _ZydisGetRegisterWidth(g_TargetCPUType, reg) / 8));
+        }
+    };
+
+    if (instruction.mnemonic == ZYDIS_MNEMONIC_LEA) {
+        const ZydisDecodedOperand* memOp = &operands[1];
+        if (memOp->type == ZYDIS_OPERAND_TYPE_MEMORY) {
+            // LEA Base Index    Ͽ 
+            if (memOp->mem.base != ZYDIS_REGISTER_NONE) {
+                //  ۷ ü  ó
+                ZydisDecodedOperand tmpOp = *memOp;
+                tmpOp.type = ZYDIS_OPERAND_TYPE_REGISTER; //   Ÿ ȯϿ 
+                tmpOp.reg.value = memOp->mem.base;
+                AddRead(tmpOp);
+            }
+            if (memOp->mem.index != ZYDIS_REGISTER_NONE) {
+                ZydisDecodedOperand tmpOp = *memOp;
+                tmpOp.type = ZYDIS_OPERAND_TYPE_REGISTER;
+                tmpOp.reg.value = memOp->mem.index;
+                AddRead(tmpOp);
+            }
+        }
+    }
+    else {
+        // Ϲ ɾ ó (MOV, ADD, SUB, POP, PUSH, XCHG   )
+        // 'б(Read)' Ӽ ִ  ۷   ִ θԴϴ.
+        // ZydisDecoderDecodeFull Explicit() ۷ Implicit(Ͻ) ۷带  ȯմϴ.
+        // : POP RAX -> Explicit: RAX(Write), Implicit: RSP(Read/Write), Implicit: [RSP](Read)
+
+        std::set<ZydisRegister> processedRegs;
+
+        for (int i = 0; i < instruction.operand_count; i++) {
+            if (operands[i].actions & ZYDIS_OPERAND_ACTION_READ) {
+
+                if (operands[i].type != ZYDIS_OPERAND_TYPE_REGISTER &&
+                    operands[i].type != ZYDIS_OPERAND_TYPE_MEMORY) {
+                    continue;
+                }
+
+                // Flags (RFLAGS/EFLAGS) б  帧     Ƿ ϴ  ϴ.
+                if (operands[i].type == ZYDIS_OPERAND_TYPE_REGISTER &&
+                    (operands[i].reg.value == ZYDIS_REGISTER_RFLAGS || operands[i].reg.value == ZYDIS_REGISTER_EFLAGS)) {
+                    continue;
+                }
+
+                if (operands[i].type == ZYDIS_OPERAND_TYPE_REGISTER) {
+                    ZydisRegister enclosingReg = GetTrackedRegister(ZYDIS_MACHINE_MODE_LONG_64, operands[i].reg.value);
+
+                    // ̹ ̹ ɾ  ͸ óߴٸ ǳʶ
+                    if (processedRegs.find(enclosingReg) != processedRegs.end()) {
+                        continue;
+                    }
+                    processedRegs.insert(enclosingReg);
+                }
+
+                AddRead(operands[i]);
+            }
+        }
+    }
+}
+
+void ReplayTraceSource::GetReads(TracePosition pos, std::vector<TraceLocation>& reads)
+{
+    MoveTo(pos);
+
+    std::shared_ptr<const DecodedInstruction> decoded = g_DecodeCache.Get(m_cursor);
+    if (decoded) {
+        CollectReadLocations(m_cursor, *decoded, reads);
+    }
+}
+
+// The addresses of the memory operands the instruction writes, computed from its registers.
+void ReplayTraceSource::GetMemoryWrites(TracePosition pos, std::vector<TraceLocation>& writes)
+{
+    MoveTo(pos);
+
+    std::shared_ptr<const DecodedInstruction> decoded = g_DecodeCache.Get(m_cursor);
+    if (!decoded) return;
+
+    RegisterReader registers;
+
+    for (int i = 0; i < decoded->instruction.operand_count; i++) {
+        const ZydisDecodedOperand& op = decoded->operands[i];
+        if (op.type != ZYDIS_OPERAND_TYPE_MEMORY || !(op.actions & ZYDIS_OPERAND_ACTION_MASK_WRITE)) {
+            continue;
+        }
+
+        uint64_t base = op.mem.base == ZYDIS_REGISTER_NONE ? 0 : (uint64_t)registers.Read(m_cursor, op.mem.base, false);
+        uint64_t index = op.mem.index == ZYDIS_REGISTER_NONE ? 0 : (uint64_t)registers.Read(m_cursor, op.mem.index, false);
+        uint64_t scale = (op.mem.scale == 0) ? 1 : op.mem.scale;
+        uint64_t size = op.size / 8;
+
+        if (op.mem.base == ZYDIS_REGISTER_RIP || op.mem.base == ZYDIS_REGISTER_EIP) {
+            base += decoded->instruction.length;
+        }
+
+        uint64_t address = base + (index * scale) + op.mem.disp.value;
+
+        // push/call store below the stack pointer they are decoded with.
+        if (op.visibility == ZYDIS_OPERAND_VISIBILITY_HIDDEN &&
+            (op.mem.base == ZYDIS_REGISTER_RSP || op.mem.base == ZYDIS_REGISTER_ESP || op.mem.base == ZYDIS_REGISTER_SP)) {
+            address -= size;
+        }
+
+        writes.push_back(TraceLocation::Memory(address, (uint32_t)size));
+    }
+}
+
+uint32_t ReplayTraceSource::GetThreadId(TracePosition pos)
+{
+    MoveTo(pos);
+    return (uint32_t)m_cursor->GetThreadInfo().UniqueId;
+}
+
+bool ReplayTraceSource::IsThreadStack(uint64_t address, uint64_t size, TracePosition pos)
+{
+    MoveTo(pos);
+    return m_stacks.Classify(m_cursor, address, size) == AddressClass::CurrentThreadStack;
+}
+
+uint64_t ReplayTraceSource::GetProgramCounter(TracePosition pos)
+{
+    MoveTo(pos);
+    return (uint64_t)m_cursor->GetProgramCounter();
+}
+
+std::string ReplayTraceSource::GetInstructionText(TracePosition pos)
+{
+    MoveTo(pos);
+    std::shared_ptr<const DecodedInstruction> decoded = g_DecodeCache.Get(m_cursor);
+    return decoded ? decoded->text : std::string();
+}
+
+TrackedRegister ReplayTraceSource::GetTrackedRegister(uint32_t reg)
+{
+    ZydisMachineMode mode = m_decoded.GetMachineMode();
+    return { (uint32_t)::GetTrackedRegister(mode, (ZydisRegister)reg), GetRegisterBytes(mode, (ZydisRegister)reg) };
+}
+
+// One replay backward over every thread with an execute watchpoint, for the registers of each
+// instruction, and a write watchpoint over the whole address space.
+bool ReplayTraceSource::CollectWrites(TracePosition pos, uint64_t windowSteps, ITraceWriteSink& sink, TracePosition& windowStart)
+{
+    struct CollectState {
+        ITraceWriteSink* sink = nullptr;
+        WrittenRegisterCache* decoded = nullptr;
+        std::vector<Position> opaque;
+    };
+
+    windowStart = {};
+    if (g_TargetCPUType != ProcessorArchitecture::x64 && g_TargetCPUType != ProcessorArchitecture::x86) {
+        return false;
+    }
+
+    CollectState state;
+    state.sink = &sink;
+    state.decoded = &m_decoded;
+
+    auto _WatchpointCallback = [](uintptr_t statePtr, ICursor::MemoryWatchpointResult const& watchpoint, IThreadView const* thread) {
+        CollectState& state = *(CollectState*)statePtr;
+
+        if (watchpoint.AccessType != DataAccessType::Execute) {
+            // Same adjustment as FindMemoryWrite: the replay reports the position after the writer.
+            return !state.sink->AddMemoryWrite((uint64_t)watchpoint.Address, watchpoint.Size, FromPosition(thread->GetPosition() - 1));
+        }
+
+        const RegisterWriteSet& set = state.decoded->Get(thread);
+        if (set.count == 0 && !set.opaque) {
+            return false;
+        }
+
+        TracePosition writer = FromPosition(thread->GetPosition());
+        uint32_t threadId = (uint32_t)thread->GetThreadInfo().UniqueId;
+
+        // A full sink leaves the writes of older steps out, so every write it has is still the
+        // newest one of its location and the window simply starts at this step.
+        for (uint8_t i = 0; i < set.count; i++) {
+            if (!(set.conditional & (1u << i)) && !state.sink->AddRegisterWrite(threadId, set.regs[i], set.bytes[i], writer)) {
+                return true;
+            }
+        }
+
+        // Conditional writes are resolved like opaque ones, by checking what actually changed.
+        if (set.opaque || set.conditional) {
+            state.opaque.push_back(thread->GetPosition());
+        }
+
+        return false;
+    };
+
+    MoveTo(pos);
+
+    MemoryWatchpointData executeWatch = { GuestAddress::Min, (uint64_t)GuestAddress::Max, DataAccessMask::Execute };
+    MemoryWatchpointData writeWatch = { GuestAddress::Min, (uint64_t)GuestAddress::Max, DataAccessMask::Write };
+
+    m_cursor->AddMemoryWatchpoint(executeWatch);
+    m_cursor->AddMemoryWatchpoint(writeWatch);
+    m_cursor->SetEventMask(EventMask::MemoryWatchpoint);
+    m_cursor->SetReplayFlags(ReplayFlags::None);
+    m_cursor->SetMemoryWatchpointCallback(_WatchpointCallback, (uintptr_t)&state);
+
+    ICursor::ReplayResult result = m_cursor->ReplayBackward(Position::Min, windowSteps == 0 ? StepCount::Max : StepCount{ windowSteps });
+
+    m_cursor->RemoveMemoryWatchpoint(executeWatch);
+    m_cursor->RemoveMemoryWatchpoint(writeWatch);
+    m_cursor->SetMemoryWatchpointCallback(nullptr, 0);
+
+    Position start = m_cursor->GetPosition();
+    windowStart = FromPosition(start);
+    bool reachesStart = result.StopReason != EventType::MemoryWatchpoint &&
+        (windowSteps == 0 || start <= m_cursor->GetReplayEngine()->GetLifetime().Min);
+
+    ResolveOpaqueWrites(state.opaque, sink);
+    return reachesStart;
+}
+
+// Registers changed by an opaque instruction are found by stepping over it and comparing contexts.
+// The xmm registers are compared too, since fxrstor and xrstor reload them.
+void ReplayTraceSource::ResolveOpaqueWrites(std::vector<Position> const& positions, ITraceWriteSink& sink)
+{
+    const ZydisRegister* regs = c_x64GeneralRegisters;
+    size_t regCount = std::size(c_x64GeneralRegisters);
+    if (m_decoded.GetMachineMode() != ZYDIS_MACHINE_MODE_LONG_64) {
+        regs = c_x86GeneralRegisters;
+        regCount = std::size(c_x86GeneralRegisters);
+    }
+
+    m_cursor->SetEventMask(EventMask::None);
+    m_cursor->SetReplayFlags(ReplayFlags::ReplayOnlyCurrentThread);
+
+    for (Position const& pos : positions) {
+        m_cursor->SetPosition(pos);
+        uint32_t threadId = (uint32_t)m_cursor->GetThreadInfo().UniqueId;
+        GlobalContext before = GetGlobalContext(m_cursor);
+
+        m_cursor->ReplayForward(Position::Max, StepCount{ 1 });
+        GlobalContext after = GetGlobalContext(m_cursor);
+
+        for (size_t i = 0; i < regCount; i++) {
+            if (GetRegisterValue(before, regs[i], false) != GetRegisterValue(after, regs[i], false) &&
+                !sink.AddRegisterWrite(threadId, regs[i], 0xffff, FromPosition(pos))) {
+                return;
+            }
+        }
+    }
+}
@@ -0,0 +1,53 @@
+// ReplayTraceSource.h
+//
+// ITraceSource on a TTD cursor: the production source of _TimeTrack, one per worker. Write searches
+// replay backward with a watchpoint (execute for registers, write for memory) under the query's
+// budget, reads and memory writes come from the decoded instruction at the position, and stack
+// memory is recognized by the StackClassifier the workers share.
+#pragma once
+#include "stdafx.h"
+
+#include <TTD/IReplayEngine.h>
+
+#include "disasm_helper.h"
+#include "StackClassifier.h"
+#include "TraceSource.h"
+
+using namespace TTD;
+using namespace Replay;
+
+class ReplayTraceSource : public ITraceSource {
+public:
+    // The cursor is moved by every call and not restored. g_TargetCPUType must be set.
+    ReplayTraceSource(ICursor* cursor, StackClassifier& stacks);
+
+    TracePosition FindRegisterWrite(uint32_t reg, TracePosition pos, bool stopAtDefinition, QueryBudget* budget) override;
+    TracePosition FindMemoryWrite(uint64_t address, uint64_t size, TracePosition pos, QueryBudget* budget, bool currentThreadOnly) override;
+    void FindMemoryWrites(std::vector<MemoryWriteQuery>& queries, QueryBudget* budget, bool currentThreadOnly) override;
+    TracePosition FindFrameEntry(TracePosition pos, QueryBudget* budget) override;
+
+    void GetReads(TracePosition pos, std::vector<TraceLocation>& reads) override;
+    void GetMemoryWrites(TracePosition pos, std::vector<TraceLocation>& writes) override;
+    uint32_t GetThreadId(TracePosition pos) override;
+    bool IsThreadStack(uint64_t address, uint64_t size, TracePosition pos) override;
+    uint64_t GetProgramCounter(TracePosition pos) override;
+    std::string GetInstructionText(TracePosition pos) override;
+    TrackedRegister GetTrackedRegister(uint32_t reg) override;
+
+    bool CollectWrites(TracePosition pos, uint64_t windowSteps, ITraceWriteSink& sink, TracePosition& windowStart) override;
+
+    static Position ToPosition(TracePosition pos);
+    static TracePosition FromPosition(Position const& pos);
+
+private:
+    // Most calls ask about the position the previous one left the cursor at.
+    void MoveTo(TracePosition pos);
+
+    void ResolveOpaqueWrites(std::vector<Position> const& positions, ITraceWriteSink& sink);
+
+    ICursor* m_cursor;
+    StackClassifier& m_stacks;
+
+    // Kept across searches so each PC is decoded once per worker, not once per search.
+    WrittenRegisterCache m_decoded;
+};
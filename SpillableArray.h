@@ -0,0 +1,235 @@
+// SpillableArray.h
+//
+// Growable array of trivially copyable values used for the TraceRecordStore columns. It lives in
+// a chunked arena until it holds more than the spill threshold, then moves into a memory-mapped
+// delete-on-close temporary file that grows by remapping. Growth is not thread-safe and
+// invalidates references; the owner serializes it.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+template <typename T>
+class SpillableArray {
+    static_assert(std::is_trivially_copyable_v<T>, "SpillableArray stores raw values");
+
+public:
+    explicit SpillableArray(size_t spillThreshold) : m_spillThreshold(spillThreshold) {}
+    ~SpillableArray() { ReleaseFile(); }
+
+    SpillableArray(SpillableArray&& other) noexcept { *this = std::move(other); }
+    SpillableArray& operator=(SpillableArray&& other) noexcept {
+        if (this != &other) {
+            ReleaseFile();
+            m_spillThreshold = other.m_spillThreshold;
+            m_spillFailed = other.m_spillFailed;
+            m_size = std::exchange(other.m_size, 0);
+            m_chunks = std::move(other.m_chunks);
+            m_file = std::exchange(other.m_file, c_noFile);
+#ifdef _WIN32
+            m_mapping = std::exchange(other.m_mapping, nullptr);
+#endif
+            m_view = std::exchange(other.m_view, nullptr);
+            m_viewCapacity = std::exchange(other.m_viewCapacity, 0);
+        }
+        return *this;
+    }
+    SpillableArray(const SpillableArray&) = delete;
+    SpillableArray& operator=(const SpillableArray&) = delete;
+
+    size_t size() const { return m_size; }
+    bool IsSpilled() const { return m_view != nullptr; }
+
+    T& operator[](size_t index) {
+        if (m_view) return m_view[index];
+        return m_chunks[index >> c_chunkShift][index & (c_chunkSize - 1)];
+    }
+    const T& operator[](size_t index) const {
+        if (m_view) return m_view[index];
+        return m_chunks[index >> c_chunkShift][index & (c_chunkSize - 1)];
+    }
+
+    // Grows to 'size' elements, new elements are set to 'fill'. Returns false when the
+    // mapped file cannot grow; the array keeps its previous size then.
+    bool Grow(size_t size, T fill = T{}) {
+        if (size <= m_size) return true;
+
+        if (!m_view && !m_spillFailed && size > m_spillThreshold) {
+            m_spillFailed = !Spill();
+        }
+
+        if (m_view) {
+            if (size > m_viewCapacity && !MapView(std::max(size, m_viewCapacity * 2))) {
+                return false;
+            }
+        }
+        else {
+            while (m_chunks.size() * c_chunkSize < size) {
+                m_chunks.push_back(std::make_unique<T[]>(c_chunkSize));
+            }
+        }
+
+        for (size_t i = m_size; i < size; i++) {
+            (*this)[i] = fill;
+        }
+        m_size = size;
+        return true;
+    }
+
+    void Clear() {
+        ReleaseFile();
+        m_chunks.clear();
+        m_size = 0;
+        m_spillFailed = false;
+    }
+
+    size_t GetMemoryUsage() const {
+        return m_view ? 0 : m_chunks.size() * c_chunkSize * sizeof(T);
+    }
+
+private:
+    static constexpr unsigned c_chunkShift = 12;
+    static constexpr size_t c_chunkSize = (size_t)1 << c_chunkShift;
+
+#ifdef _WIN32
+    using FileHandle = HANDLE;
+    static inline const FileHandle c_noFile = INVALID_HANDLE_VALUE;
+#else
+    using FileHandle = int;
+    static constexpr FileHandle c_noFile = -1;
+#endif
+
+    // Moves the arena into a memory-mapped temporary file. On failure the arena keeps growing.
+    bool Spill() {
+        if (!CreateTempFile()) {
+            return false;
+        }
+
+        if (!MapView(std::max<size_t>(m_size * 2, c_chunkSize))) {
+            ReleaseFile();
+            return false;
+        }
+
+        for (size_t i = 0; i < m_size; i++) {
+            m_view[i] = m_chunks[i >> c_chunkShift][i & (c_chunkSize - 1)];
+        }
+        m_chunks.clear();
+        return true;
+    }
+
+#ifdef _WIN32
+    bool CreateTempFile() {
+        char tempPath[MAX_PATH];
+        char tempFile[MAX_PATH];
+        if (!GetTempPathA(MAX_PATH, tempPath) || !GetTempFileNameA(tempPath, "ttr", 0, tempFile)) {
+            return false;
+        }
+
+        m_file = CreateFileA(tempFile, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+        return m_file != INVALID_HANDLE_VALUE;
+    }
+
+    // (Re)maps the file with room for 'capacity' elements; mapping a larger size grows the file.
+    // The previous view stays valid until the new one is mapped, so a failure loses nothing.
+    bool MapView(size_t capacity) {
+        uint64_t bytes = (uint64_t)capacity * sizeof(T);
+        HANDLE mapping = CreateFileMappingA(m_file, NULL, PAGE_READWRITE, (DWORD)(bytes >> 32), (DWORD)bytes, NULL);
+        if (!mapping) {
+            return false;
+        }
+
+        T* view = (T*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)bytes);
+        if (!view) {
+            CloseHandle(mapping);
+            return false;
+        }
+
+        if (m_view) UnmapViewOfFile(m_view);
+        if (m_mapping) CloseHandle(m_mapping);
+
+        m_mapping = mapping;
+        m_view = view;
+        m_viewCapacity = capacity;
+        return true;
+    }
+
+    void ReleaseFile() {
+        if (m_view) UnmapViewOfFile(m_view);
+        if (m_mapping) CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+
+        m_view = nullptr;
+        m_mapping = nullptr;
+        m_file = INVALID_HANDLE_VALUE;
+        m_viewCapacity = 0;
+    }
+#else
+    // The file is unlinked right away, so it goes away with the descriptor like FILE_FLAG_DELETE_ON_CLOSE.
+    bool CreateTempFile() {
+        const char* dir = getenv("TMPDIR");
+        std::string path = std::string(dir && *dir ? dir : "/tmp") + "/ttrXXXXXX";
+
+        m_file = mkstemp(path.data());
+        if (m_file < 0) {
+            return false;
+        }
+        unlink(path.c_str());
+        return true;
+    }
+
+    // Same contract as the Windows version; the file is grown first, then the larger view is mapped.
+    bool MapView(size_t capacity) {
+        size_t bytes = capacity * sizeof(T);
+        if (ftruncate(m_file, (off_t)bytes) != 0) {
+            return false;
+        }
+
+        void* view = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+        if (view == MAP_FAILED) {
+            return false;
+        }
+
+        if (m_view) munmap(m_view, m_viewCapacity * sizeof(T));
+
+        m_view = (T*)view;
+        m_viewCapacity = capacity;
+        return true;
+    }
+
+    void ReleaseFile() {
+        if (m_view) munmap(m_view, m_viewCapacity * sizeof(T));
+        if (m_file >= 0) close(m_file);
+
+        m_view = nullptr;
+        m_file = -1;
+        m_viewCapacity = 0;
+    }
+#endif
+
+    size_t m_spillThreshold = 0;
+    bool m_spillFailed = false;
+    size_t m_size = 0;
+
+    std::vector<std::unique_ptr<T[]>> m_chunks;
+
+    FileHandle m_file = c_noFile;
+#ifdef _WIN32
+    HANDLE m_mapping = nullptr;
+#endif
+    T* m_view = nullptr;
+    size_t m_viewCapacity = 0;
+};
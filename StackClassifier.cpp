@@ -0,0 +1,56 @@
+#include "StackClassifier.h"
+
+#include <TTD/IReplayEngineStl.h>
+
+// NT_TIB: ExceptionList, StackBase, StackLimit, each pointer sized. An unreadable TEB leaves
+// the range empty.
+bool StackClassifier::ReadStackRange(ICursor* cursor, StackRange& range) const
+{
+    uint64_t teb = (uint64_t)cursor->GetTebAddress();
+    if (teb == 0) return false;
+
+    if (m_architecture == ProcessorArchitecture::x64) {
+        uint64_t tib[3] = {};
+        BufferView bufferView{ tib, sizeof(tib) };
+        cursor->QueryMemoryBuffer((GuestAddress)teb, bufferView);
+        range.base = tib[1];
+        range.limit = tib[2];
+    }
+    else {
+        uint32_t tib[3] = {};
+        BufferView bufferView{ tib, sizeof(tib) };
+        cursor->QueryMemoryBuffer((GuestAddress)teb, bufferView);
+        range.base = tib[1];
+        range.limit = tib[2];
+    }
+
+    return range.limit < range.base;
+}
+
+AddressClass StackClassifier::Classify(ICursor* cursor, uint64_t address, uint64_t size)
+{
+    UniqueThreadId threadId = cursor->GetThreadInfo().UniqueId;
+
+    StackRange current;
+    bool haveCurrent = ReadStackRange(cursor, current);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (haveCurrent) {
+        auto [it, inserted] = m_stacks.try_emplace(threadId, current);
+        if (!inserted && current.limit < it->second.limit) {
+            it->second.limit = current.limit;
+        }
+        if (it->second.Contains(address, size)) {
+            return AddressClass::CurrentThreadStack;
+        }
+    }
+
+    for (const auto& [otherId, range] : m_stacks) {
+        if (otherId != threadId && range.Contains(address, size)) {
+            return AddressClass::OtherThreadStack;
+        }
+    }
+
+    return AddressClass::Shared;
+}
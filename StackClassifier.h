@@ -0,0 +1,43 @@
+// StackClassifier.h
+//
+// Sorts the address of a memory work item into the current thread's stack, another thread's
+// stack or shared memory. Stack ranges come from the NT_TIB at the start of each thread's TEB
+// and are remembered per thread, so "another thread's stack" means a stack seen earlier.
+#pragma once
+#include "stdafx.h"
+
+#include <mutex>
+#include <unordered_map>
+
+#include <TTD/IReplayEngine.h>
+
+using namespace TTD;
+using namespace Replay;
+
+enum class AddressClass {
+    CurrentThreadStack,
+    OtherThreadStack,
+    Shared,
+};
+
+class StackClassifier {
+public:
+    explicit StackClassifier(ProcessorArchitecture architecture) : m_architecture(architecture) {}
+
+    // Thread-safe. The current thread is the one the cursor is on.
+    AddressClass Classify(ICursor* cursor, uint64_t address, uint64_t size);
+
+private:
+    struct StackRange {
+        uint64_t limit = 0; // lowest StackLimit seen, the stack grows down towards it
+        uint64_t base = 0;
+        bool Contains(uint64_t address, uint64_t size) const { return limit <= address && address + size <= base; }
+    };
+
+    bool ReadStackRange(ICursor* cursor, StackRange& range) const;
+
+    ProcessorArchitecture m_architecture;
+
+    std::mutex m_mutex;
+    std::unordered_map<UniqueThreadId, StackRange> m_stacks;
+};
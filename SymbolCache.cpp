@@ -0,0 +1,139 @@
+#include "SymbolCache.h"
+
+#include <algorithm>
+
+#include "TrackStats.h"
+
+void SymbolCache::BindTo(const void* trace)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_trace == trace) return;
+
+    m_modules.clear();
+    m_unmapped.clear();
+    m_trace = trace;
+}
+
+void SymbolCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_modules.clear();
+    m_unmapped.clear();
+    m_hits = 0;
+    m_misses = 0;
+}
+
+SymbolName SymbolCache::Get(IDebugSymbols3* symbols, uint64_t pc)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Module* module = FindModule(symbols, pc);
+    if (module) {
+        auto it = module->functions.upper_bound(pc);
+        if (it != module->functions.begin()) {
+            --it;
+            if (pc < it->second.end) {
+                m_hits++;
+                return { it->second.name, pc - it->first };
+            }
+        }
+
+        auto offset = module->offsets.find(pc);
+        if (offset != module->offsets.end()) {
+            m_hits++;
+            return offset->second;
+        }
+    }
+    else {
+        auto offset = m_unmapped.find(pc);
+        if (offset != m_unmapped.end()) {
+            m_hits++;
+            return offset->second;
+        }
+    }
+
+    m_misses++;
+    ScopedPhaseTimer timer(TrackPhase::Symbol);
+    return Resolve(symbols, pc, module);
+}
+
+void SymbolCache::Prefetch(IDebugSymbols3* symbols, std::vector<uint64_t> pcs)
+{
+    std::sort(pcs.begin(), pcs.end());
+    pcs.erase(std::unique(pcs.begin(), pcs.end()), pcs.end());
+
+    for (uint64_t pc : pcs) {
+        Get(symbols, pc);
+    }
+}
+
+size_t SymbolCache::GetFunctionCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t count = 0;
+    for (const auto& [base, module] : m_modules) {
+        count += module.functions.size();
+    }
+    return count;
+}
+
+// m_mutex must be held.
+SymbolCache::Module* SymbolCache::FindModule(IDebugSymbols3* symbols, uint64_t pc)
+{
+    auto it = m_modules.upper_bound(pc);
+    if (it != m_modules.begin()) {
+        --it;
+        if (pc < it->second.end) return &it->second;
+    }
+
+    ULONG64 base = 0;
+    DEBUG_MODULE_PARAMETERS params = {};
+    if (FAILED(symbols->GetModuleByOffset(pc, 0, NULL, &base)) ||
+        FAILED(symbols->GetModuleParameters(1, &base, 0, &params)) || params.Size == 0) {
+        return nullptr;
+    }
+
+    Module& module = m_modules[base];
+    module.end = base + params.Size;
+    return &module;
+}
+
+// m_mutex must be held. Caches the function range around 'pc' when the symbol has a size.
+SymbolName SymbolCache::Resolve(IDebugSymbols3* symbols, uint64_t pc, Module* module)
+{
+    SymbolName result;
+
+    char buffer[256];
+    ULONG64 displacement = 0;
+    if (SUCCEEDED(symbols->GetNameByOffset(pc, buffer, sizeof(buffer), NULL, &displacement))) {
+        result.name = buffer;
+        result.displacement = displacement;
+    }
+    else {
+        result.displacement = pc;
+    }
+
+    if (!module) {
+        m_unmapped.emplace(pc, result);
+        return result;
+    }
+
+    DEBUG_MODULE_AND_ID id = {};
+    ULONG64 entryDisplacement = 0;
+    ULONG entries = 0;
+    DEBUG_SYMBOL_ENTRY entry = {};
+
+    if (!result.name.empty() &&
+        SUCCEEDED(symbols->GetSymbolEntriesByOffset(pc, 0, &id, &entryDisplacement, 1, &entries)) && entries != 0 &&
+        SUCCEEDED(symbols->GetSymbolEntryInformation(&id, &entry)) &&
+        entry.Size != 0 && entry.Offset == pc - displacement && pc < entry.Offset + entry.Size) {
+        module->functions[entry.Offset] = { std::min<uint64_t>(entry.Offset + entry.Size, module->end), result.name };
+    }
+    else {
+        // Export-only or stripped modules: the nearest name says nothing about the next offset.
+        module->offsets.emplace(pc, result);
+    }
+
+    return result;
+}
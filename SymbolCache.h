@@ -0,0 +1,65 @@
+// SymbolCache.h
+//
+// Per-session cache for IDebugSymbols3::GetNameByOffset. Results are bucketed by module, and
+// inside a module by function range, so the first lookup in a function serves every other
+// offset in it. PCs whose symbol has no known size are cached one by one.
+#pragma once
+#include "stdafx.h"
+
+#include <Windows.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <DbgEng.h>
+
+struct SymbolName {
+    std::string name; // empty when dbgeng has no name for the offset
+    uint64_t displacement = 0;
+};
+
+class SymbolCache {
+public:
+    // Drops every entry when the trace changes.
+    void BindTo(const void* trace);
+    void Clear();
+
+    // Thread-safe; lookups through dbgeng are serialized.
+    SymbolName Get(IDebugSymbols3* symbols, uint64_t pc);
+
+    // Resolves 'pcs' up front, in address order so each function costs one lookup.
+    void Prefetch(IDebugSymbols3* symbols, std::vector<uint64_t> pcs);
+
+    uint64_t GetHits() const { return m_hits; }
+    uint64_t GetMisses() const { return m_misses; }
+    size_t GetFunctionCount();
+
+private:
+    struct Function {
+        uint64_t end;
+        std::string name;
+    };
+
+    struct Module {
+        uint64_t end;
+        std::map<uint64_t, Function> functions; // by start offset
+        std::unordered_map<uint64_t, SymbolName> offsets;
+    };
+
+    Module* FindModule(IDebugSymbols3* symbols, uint64_t pc);
+    SymbolName Resolve(IDebugSymbols3* symbols, uint64_t pc, Module* module);
+
+    std::mutex m_mutex;
+    std::map<uint64_t, Module> m_modules; // by base address
+    std::unordered_map<uint64_t, SymbolName> m_unmapped; // PCs outside every module
+
+    const void* m_trace = nullptr;
+
+    std::atomic<uint64_t> m_hits{ 0 };
+    std::atomic<uint64_t> m_misses{ 0 };
+};
+
+extern SymbolCache g_SymbolCache;
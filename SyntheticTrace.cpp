@@ -0,0 +1,296 @@
+#include "SyntheticTrace.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "TrackBudget.h"
+#include "TrackStats.h"
+
+TracePosition SyntheticTrace::AddStep(Step step)
+{
+    uint32_t index = (uint32_t)m_steps.size();
+
+    for (const TraceLocation& write : step.writes) {
+        if (write.type == TraceLocationType::Register) {
+            TrackedRegister tracked = GetTrackedRegister(write.reg);
+            m_registerWrites[RegisterKey(step.thread, tracked.reg)].push_back({ index, tracked.bytes });
+            continue;
+        }
+
+        if (write.size == 0) continue;
+        uint64_t first = write.address >> c_granuleShift;
+        uint64_t last = (write.address + write.size - 1) >> c_granuleShift;
+        for (uint64_t granule = first; granule <= last; granule++) {
+            std::vector<uint32_t>& writes = m_memoryWrites[granule];
+            if (writes.empty() || writes.back() != index) writes.push_back(index);
+        }
+    }
+
+    m_steps.push_back(std::move(step));
+    return { index, 0 };
+}
+
+void SyntheticTrace::SetSubRegister(uint32_t reg, uint32_t enclosingReg, uint16_t bytes)
+{
+    m_subRegisters[reg] = { enclosingReg, bytes };
+}
+
+void SyntheticTrace::SetThreadStack(uint32_t thread, uint64_t limit, uint64_t base)
+{
+    m_stacks[thread] = { limit, base };
+}
+
+int64_t SyntheticTrace::Replay(QueryBudget* budget, uint64_t pos, int64_t found, uint64_t& reached)
+{
+    uint64_t windowStart = budget ? std::min(budget->GetWindowStart().sequence, pos) : 0;
+    bool inWindow = found != c_noStep && (uint64_t)found >= windowStart;
+    uint64_t distance = pos - (inWindow ? (uint64_t)found : windowStart);
+
+    if (!budget) {
+        reached = pos - distance;
+        g_TrackStats.Add(TrackCounter::ReplaySteps, distance);
+        g_TrackStats.AddReplayDistance(distance);
+        return found;
+    }
+
+    uint64_t before = budget->GetSteps();
+    bool complete = budget->Charge(distance);
+    uint64_t charged = budget->GetSteps() - before;
+
+    reached = pos - charged;
+    budget->SetStopPosition({ reached, 0 });
+    g_TrackStats.Add(TrackCounter::ReplaySteps, charged);
+    g_TrackStats.AddReplayDistance(charged);
+
+    if (!complete) return c_noStep;
+    if (inWindow) return found;
+
+    // Like a replay that stops at the window start instead of the start of the trace.
+    if (windowStart > 0) budget->MarkOutsideWindow();
+    return c_noStep;
+}
+
+TracePosition SyntheticTrace::FindRegisterWrite(uint32_t reg, TracePosition pos, bool, QueryBudget* budget)
+{
+    if (!IsStep(pos)) return {};
+    uint32_t before = (uint32_t)pos.sequence;
+    TrackedRegister tracked = GetTrackedRegister(reg);
+
+    int64_t found = c_noStep;
+    auto it = m_registerWrites.find(RegisterKey(m_steps[before].thread, tracked.reg));
+    if (it != m_registerWrites.end()) {
+        const std::vector<RegisterWrite>& writes = it->second;
+        auto older = std::lower_bound(writes.begin(), writes.end(), before, [](RegisterWrite const& w, uint32_t step) { return w.step < step; });
+
+        // Writes that leave the bytes of 'reg' alone (ah while tracking al) are skipped.
+        while (older != writes.begin()) {
+            --older;
+            if (older->bytes & tracked.bytes) {
+                found = older->step;
+                break;
+            }
+        }
+    }
+
+    uint64_t reached;
+    found = Replay(budget, before, found, reached);
+    if (found == c_noStep) return {};
+    return { (uint64_t)found, 0 };
+}
+
+int64_t SyntheticTrace::FindMemoryStep(uint64_t address, uint64_t size, uint32_t before, const uint32_t* onlyThread) const
+{
+    if (size == 0) return c_noStep;
+
+    // Newest write strictly before 'before' that overlaps any byte of the location.
+    int64_t best = c_noStep;
+    uint64_t first = address >> c_granuleShift;
+    uint64_t last = (address + size - 1) >> c_granuleShift;
+    for (uint64_t granule = first; granule <= last; granule++) {
+        auto it = m_memoryWrites.find(granule);
+        if (it == m_memoryWrites.end()) continue;
+
+        const std::vector<uint32_t>& writes = it->second;
+        for (auto older = std::lower_bound(writes.begin(), writes.end(), before); older != writes.begin();) {
+            --older;
+            if ((int64_t)*older <= best) break;
+
+            const Step& step = m_steps[*older];
+            if (onlyThread && step.thread != *onlyThread) continue;
+
+            bool overlaps = false;
+            for (const TraceLocation& write : step.writes) {
+                if (write.type == TraceLocationType::Memory &&
+                    write.address < address + size && address < write.address + write.size) {
+                    overlaps = true;
+                    break;
+                }
+            }
+            if (overlaps) {
+                best = *older;
+                break;
+            }
+        }
+    }
+
+    return best;
+}
+
+TracePosition SyntheticTrace::FindMemoryWrite(uint64_t address, uint64_t size, TracePosition pos, QueryBudget* budget, bool currentThreadOnly)
+{
+    if (!IsStep(pos)) return {};
+    uint32_t before = (uint32_t)pos.sequence;
+    uint32_t thread = m_steps[before].thread;
+
+    int64_t found = FindMemoryStep(address, size, before, currentThreadOnly ? &thread : nullptr);
+
+    uint64_t reached;
+    found = Replay(budget, before, found, reached);
+    if (found == c_noStep) return {};
+    return { (uint64_t)found, 0 };
+}
+
+// One replay from the latest query position back to the oldest write the batch needs; a query
+// keeps its write only if the replay got that far.
+void SyntheticTrace::FindMemoryWrites(std::vector<MemoryWriteQuery>& queries, QueryBudget* budget, bool currentThreadOnly)
+{
+    if (queries.empty()) return;
+
+    TracePosition start = queries[0].pos;
+    for (const MemoryWriteQuery& query : queries) {
+        if (start < query.pos) start = query.pos;
+    }
+    if (!IsStep(start)) return;
+    uint32_t thread = m_steps[(size_t)start.sequence].thread;
+
+    std::vector<int64_t> found(queries.size());
+    int64_t oldest = INT64_MAX;
+    for (size_t i = 0; i < queries.size(); i++) {
+        found[i] = FindMemoryStep(queries[i].address, queries[i].size, (uint32_t)queries[i].pos.sequence, currentThreadOnly ? &thread : nullptr);
+        oldest = std::min(oldest, found[i]);
+    }
+
+    uint64_t reached;
+    Replay(budget, start.sequence, oldest, reached);
+
+    for (size_t i = 0; i < queries.size(); i++) {
+        if (found[i] != c_noStep && (uint64_t)found[i] >= reached) {
+            queries[i].result = { (uint64_t)found[i], 0 };
+        }
+    }
+}
+
+TracePosition SyntheticTrace::FindFrameEntry(TracePosition pos, QueryBudget*)
+{
+    if (!IsStep(pos)) return {};
+    uint32_t thread = m_steps[(size_t)pos.sequence].thread;
+
+    int depth = 0;
+    for (uint64_t i = pos.sequence; i-- > 0;) {
+        const Step& step = m_steps[(size_t)i];
+        if (step.thread != thread) continue;
+
+        if (step.ret) {
+            depth++;
+        }
+        else if (step.call) {
+            if (depth == 0) return { i, 0 };
+            depth--;
+        }
+    }
+    return {};
+}
+
+void SyntheticTrace::GetReads(TracePosition pos, std::vector<TraceLocation>& reads)
+{
+    if (!IsStep(pos)) return;
+    const Step& step = m_steps[(size_t)pos.sequence];
+    reads.insert(reads.end(), step.reads.begin(), step.reads.end());
+}
+
+void SyntheticTrace::GetMemoryWrites(TracePosition pos, std::vector<TraceLocation>& writes)
+{
+    if (!IsStep(pos)) return;
+    for (const TraceLocation& write : m_steps[(size_t)pos.sequence].writes) {
+        if (write.IsMemory()) writes.push_back(write);
+    }
+}
+
+uint32_t SyntheticTrace::GetThreadId(TracePosition pos)
+{
+    if (!IsStep(pos)) return 0;
+    return m_steps[(size_t)pos.sequence].thread;
+}
+
+bool SyntheticTrace::IsThreadStack(uint64_t address, uint64_t size, TracePosition pos)
+{
+    if (!IsStep(pos)) return false;
+    auto it = m_stacks.find(m_steps[(size_t)pos.sequence].thread);
+    return it != m_stacks.end() && it->second.limit <= address && address + size <= it->second.base;
+}
+
+uint64_t SyntheticTrace::GetProgramCounter(TracePosition pos)
+{
+    if (!IsStep(pos)) return 0;
+    return m_steps[(size_t)pos.sequence].pc;
+}
+
+std::string SyntheticTrace::GetInstructionText(TracePosition pos)
+{
+    if (!IsStep(pos)) return {};
+    return m_steps[(size_t)pos.sequence].text;
+}
+
+TrackedRegister SyntheticTrace::GetTrackedRegister(uint32_t reg)
+{
+    auto it = m_subRegisters.find(reg);
+    if (it != m_subRegisters.end()) return it->second;
+    return { reg, 0xffff };
+}
+
+// A full sink stops the walk at step i; the window then starts after it, so it only covers
+// steps whose writes were all recorded.
+bool SyntheticTrace::CollectWrites(TracePosition pos, uint64_t windowSteps, ITraceWriteSink& sink, TracePosition& windowStart)
+{
+    uint64_t end = std::min<uint64_t>(pos.IsValid() ? pos.sequence : 0, m_steps.size());
+    uint64_t start = windowSteps != 0 && end > windowSteps ? end - windowSteps : 0;
+
+    for (uint64_t i = end; i-- > start;) {
+        const Step& step = m_steps[(size_t)i];
+        bool full = false;
+
+        for (const TraceLocation& write : step.writes) {
+            if (write.IsMemory()) {
+                full = !sink.AddMemoryWrite(write.address, write.size, { i, 0 });
+            }
+            else {
+                TrackedRegister tracked = GetTrackedRegister(write.reg);
+                full = !sink.AddRegisterWrite(step.thread, tracked.reg, tracked.bytes, { i, 0 });
+            }
+            if (full) break;
+        }
+
+        if (full) {
+            windowStart = { i + 1, 0 };
+            return false;
+        }
+    }
+
+    windowStart = { start, 0 };
+    return start == 0;
+}
+
+size_t SyntheticTrace::GetMemoryUsage() const
+{
+    size_t usage = m_steps.capacity() * sizeof(Step);
+    for (const Step& step : m_steps) {
+        usage += (step.reads.capacity() + step.writes.capacity()) * sizeof(TraceLocation) + step.text.capacity();
+    }
+    for (const auto& [key, writes] : m_registerWrites) {
+        usage += sizeof(key) + writes.capacity() * sizeof(RegisterWrite);
+    }
+    for (const auto& [granule, writes] : m_memoryWrites) {
+        usage += sizeof(granule) + writes.capacity() * sizeof(uint32_t);
+    }
+    return usage;
+}
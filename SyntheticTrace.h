@@ -0,0 +1,94 @@
+// SyntheticTrace.h
+//
+// In-memory trace for running the backtracking engine without a TTD recording. A trace is a flat
+// list of steps, each with its thread, program counter and the locations it reads and writes.
+// Step i sits at TracePosition{ i, 0 }. Writes are indexed per register and thread, and per 8-byte
+// memory granule, so a write search is a binary search instead of a backward scan. Searches still
+// charge their QueryBudget the steps a backward replay would cover, so budgets and windows behave
+// as they do on a recording.
+//
+// Every write is taken to change the value it writes, so stopAtDefinition makes no difference.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "TraceSource.h"
+
+class SyntheticTrace : public ITraceSource {
+public:
+    struct Step {
+        uint32_t thread = 0;
+        uint64_t pc = 0;
+        std::vector<TraceLocation> reads;
+        std::vector<TraceLocation> writes;
+        bool call = false;  // enters a function, for FindFrameEntry
+        bool ret = false;
+        std::string text;
+    };
+
+    // Appends a step and returns its position.
+    TracePosition AddStep(Step step);
+
+    // Makes 'reg' the bytes 'bytes' of 'enclosingReg', like al and ah of rax. Set up before AddStep.
+    void SetSubRegister(uint32_t reg, uint32_t enclosingReg, uint16_t bytes);
+
+    // [limit, base) is the stack of 'thread'.
+    void SetThreadStack(uint32_t thread, uint64_t limit, uint64_t base);
+
+    size_t GetStepCount() const { return m_steps.size(); }
+    const Step& GetStep(TracePosition pos) const { return m_steps[(size_t)pos.sequence]; }
+    size_t GetMemoryUsage() const;
+
+    TracePosition FindRegisterWrite(uint32_t reg, TracePosition pos, bool stopAtDefinition, QueryBudget* budget) override;
+    TracePosition FindMemoryWrite(uint64_t address, uint64_t size, TracePosition pos, QueryBudget* budget, bool currentThreadOnly) override;
+    void FindMemoryWrites(std::vector<MemoryWriteQuery>& queries, QueryBudget* budget, bool currentThreadOnly) override;
+    TracePosition FindFrameEntry(TracePosition pos, QueryBudget* budget) override;
+
+    void GetReads(TracePosition pos, std::vector<TraceLocation>& reads) override;
+    void GetMemoryWrites(TracePosition pos, std::vector<TraceLocation>& writes) override;
+    uint32_t GetThreadId(TracePosition pos) override;
+    bool IsThreadStack(uint64_t address, uint64_t size, TracePosition pos) override;
+    uint64_t GetProgramCounter(TracePosition pos) override;
+    std::string GetInstructionText(TracePosition pos) override;
+    TrackedRegister GetTrackedRegister(uint32_t reg) override;
+
+    bool CollectWrites(TracePosition pos, uint64_t windowSteps, ITraceWriteSink& sink, TracePosition& windowStart) override;
+
+private:
+    struct RegisterWrite {
+        uint32_t step;
+        uint16_t bytes;
+    };
+
+    struct StackRange {
+        uint64_t limit = 0;
+        uint64_t base = 0;
+    };
+
+    static constexpr unsigned c_granuleShift = 3;
+    static constexpr int64_t c_noStep = -1;
+
+    static uint64_t RegisterKey(uint32_t thread, uint32_t reg) { return ((uint64_t)thread << 32) | reg; }
+
+    bool IsStep(TracePosition pos) const { return pos.IsValid() && pos.sequence < m_steps.size(); }
+
+    // Newest step before 'before' that writes any byte of the range; c_noStep when there is none.
+    int64_t FindMemoryStep(uint64_t address, uint64_t size, uint32_t before, const uint32_t* onlyThread) const;
+
+    // Charges 'budget' the replay from 'pos' back to 'found' (or to the window start when there is no
+    // write in the window) and returns how far the replay got: 'found', or c_noStep when it stopped
+    // first. 'reached' is the oldest step it covered.
+    int64_t Replay(QueryBudget* budget, uint64_t pos, int64_t found, uint64_t& reached);
+
+    std::vector<Step> m_steps;
+    std::unordered_map<uint32_t, TrackedRegister> m_subRegisters;
+    std::unordered_map<uint32_t, StackRange> m_stacks;
+
+    // Step indices in ascending order.
+    std::unordered_map<uint64_t, std::vector<RegisterWrite>> m_registerWrites;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> m_memoryWrites;
+};
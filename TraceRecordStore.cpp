@@ -0,0 +1,194 @@
+#include "TraceRecordStore.h"
+
+#include <utility>
+
+TraceRecordStore::TraceRecordStore(size_t spillThreshold)
+    : m_parentIds(spillThreshold), m_refIds(spillThreshold), m_flags(spillThreshold), m_sequenceDeltas(spillThreshold), m_steps(spillThreshold)
+{
+}
+
+TraceRecordStore::TraceRecordStore(TraceRecordStore&& other) noexcept
+    : TraceRecordStore(0)
+{
+    *this = std::move(other);
+}
+
+TraceRecordStore& TraceRecordStore::operator=(TraceRecordStore&& other) noexcept
+{
+    if (this != &other) {
+        m_count = std::exchange(other.m_count, 0);
+        m_parentIds = std::move(other.m_parentIds);
+        m_refIds = std::move(other.m_refIds);
+        m_flags = std::move(other.m_flags);
+        m_sequenceDeltas = std::move(other.m_sequenceDeltas);
+        m_steps = std::move(other.m_steps);
+        m_blockSequences = std::move(other.m_blockSequences);
+        m_widePositions = std::move(other.m_widePositions);
+        m_byteRanges = std::move(other.m_byteRanges);
+        m_childOffsets = std::move(other.m_childOffsets);
+        m_children = std::move(other.m_children);
+    }
+    return *this;
+}
+
+void TraceRecordStore::Append(const TraceRecord& record)
+{
+    if (record.id <= 0) return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t size = (size_t)record.id + 1;
+    if (!m_parentIds.Grow(size, c_noRecord) || !m_refIds.Grow(size) || !m_flags.Grow(size) || !m_sequenceDeltas.Grow(size) || !m_steps.Grow(size)) {
+        return;
+    }
+
+    if (m_parentIds[record.id] == c_noRecord) {
+        m_count++;
+    }
+
+    m_parentIds[record.id] = record.parentId;
+    m_refIds[record.id] = record.refId;
+    m_flags[record.id] = record.flags;
+    SetPosition(record.id, record.pos);
+
+    if (record.byteCount != 0) {
+        m_byteRanges[record.id] = { record.byteOffset, record.byteCount };
+    }
+}
+
+void TraceRecordStore::AddFlags(int id, uint8_t flags)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (Contains(id)) {
+        m_flags[id] |= flags;
+    }
+}
+
+void TraceRecordStore::SetByteRange(int id, uint16_t offset, uint16_t count)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (Contains(id)) {
+        m_byteRanges[id] = { offset, count };
+    }
+}
+
+void TraceRecordStore::SetPosition(int id, TracePosition pos)
+{
+    size_t block = (size_t)id >> c_blockShift;
+    if (m_blockSequences.size() <= block) {
+        m_blockSequences.resize(block + 1, c_noSequence);
+    }
+
+    uint64_t sequence = pos.sequence;
+    uint64_t steps = pos.steps;
+
+    if (m_blockSequences[block] == c_noSequence) {
+        m_blockSequences[block] = sequence;
+    }
+
+    int64_t delta = (int64_t)(sequence - m_blockSequences[block]);
+    if (delta > INT32_MAX || delta <= INT32_MIN || steps > UINT32_MAX) {
+        m_sequenceDeltas[id] = c_widePosition;
+        m_steps[id] = 0;
+        m_widePositions[id] = pos;
+        return;
+    }
+
+    m_sequenceDeltas[id] = (int32_t)delta;
+    m_steps[id] = (uint32_t)steps;
+    m_widePositions.erase(id);
+}
+
+TracePosition TraceRecordStore::GetPosition(int id) const
+{
+    int32_t delta = m_sequenceDeltas[id];
+    if (delta == c_widePosition) {
+        auto it = m_widePositions.find(id);
+        return it != m_widePositions.end() ? it->second : TracePosition{};
+    }
+
+    return { m_blockSequences[(size_t)id >> c_blockShift] + (int64_t)delta, m_steps[id] };
+}
+
+TraceRecord TraceRecordStore::Get(int id) const
+{
+    TraceRecord record;
+    record.id = id;
+    record.parentId = m_parentIds[id];
+    record.refId = m_refIds[id];
+    record.flags = m_flags[id];
+    record.pos = GetPosition(id);
+
+    if (!m_byteRanges.empty()) {
+        auto it = m_byteRanges.find(id);
+        if (it != m_byteRanges.end()) {
+            record.byteOffset = it->second.first;
+            record.byteCount = it->second.second;
+        }
+    }
+    return record;
+}
+
+void TraceRecordStore::Finalize()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    int maxId = GetMaxId();
+    if (maxId < 0) maxId = 0;
+
+    // Counting sort by parentId; walking ids in order keeps siblings ordered by id.
+    m_childOffsets.assign((size_t)maxId + 2, 0);
+    for (int id = 1; id <= maxId; id++) {
+        int parentId = m_parentIds[id];
+        if (parentId == c_noRecord || parentId > maxId) continue;
+        m_childOffsets[(size_t)parentId + 1]++;
+    }
+    for (size_t i = 1; i < m_childOffsets.size(); i++) {
+        m_childOffsets[i] += m_childOffsets[i - 1];
+    }
+
+    std::vector<uint32_t> next(m_childOffsets.begin(), m_childOffsets.end() - 1);
+    m_children.resize(m_childOffsets.back());
+    for (int id = 1; id <= maxId; id++) {
+        int parentId = m_parentIds[id];
+        if (parentId == c_noRecord || parentId > maxId) continue;
+        m_children[next[parentId]++] = (uint32_t)id;
+    }
+}
+
+std::span<const uint32_t> TraceRecordStore::GetChildren(int parentId) const
+{
+    if (parentId < 0 || (size_t)parentId + 1 >= m_childOffsets.size()) {
+        return {};
+    }
+
+    uint32_t first = m_childOffsets[parentId];
+    uint32_t last = m_childOffsets[(size_t)parentId + 1];
+    return std::span<const uint32_t>(m_children.data() + first, last - first);
+}
+
+size_t TraceRecordStore::GetMemoryUsage() const
+{
+    return m_parentIds.GetMemoryUsage() + m_refIds.GetMemoryUsage() + m_flags.GetMemoryUsage() + m_sequenceDeltas.GetMemoryUsage() + m_steps.GetMemoryUsage()
+        + m_blockSequences.capacity() * sizeof(uint64_t)
+        + m_widePositions.size() * (sizeof(int) + sizeof(TracePosition))
+        + m_byteRanges.size() * (sizeof(int) + 2 * sizeof(uint16_t))
+        + (m_childOffsets.capacity() + m_children.capacity()) * sizeof(uint32_t);
+}
+
+void TraceRecordStore::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_count = 0;
+    m_parentIds.Clear();
+    m_refIds.Clear();
+    m_flags.Clear();
+    m_sequenceDeltas.Clear();
+    m_steps.Clear();
+    m_blockSequences.clear();
+    m_widePositions.clear();
+    m_byteRanges.clear();
+    m_childOffsets.clear();
+    m_children.clear();
+}
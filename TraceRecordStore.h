@@ -0,0 +1,99 @@
+// TraceRecordStore.h
+//
+// Columnar store for the TraceRecords of one _TimeTrack run. Record ids are dense (1..N, handed
+// out by the session), so the id is the index into every column. A position is stored as a
+// 32-bit sequence delta against the first sequence seen in its block of 64 ids plus a 32-bit
+// step count; the rare position that does not fit goes to a side table. A record costs 17 bytes:
+// parent id, back-reference id, sequence delta and step count at 4 bytes each plus one flag byte.
+// Finalize() builds a CSR-style child index (8 more bytes per record), so walking the tree
+// touches only flat arrays. Columns above the spill threshold move to memory-mapped temporary files.
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "SpillableArray.h"
+#include "TraceSource.h"
+
+enum TraceRecordFlags : uint8_t {
+    TraceRecordOutsideWindow = 1 << 0, // the write that defines this node lies before the lookback window
+};
+
+struct TraceRecord {
+    int id = 0;
+    int parentId = 0;
+    TracePosition pos;
+    int refId = 0; // != 0: back-reference, the subtree of record refId is the expansion of this node
+    uint8_t flags = 0;
+    uint16_t byteOffset = 0; // with byteCount != 0: the node is the origin of only these bytes of the operand
+    uint16_t byteCount = 0;
+};
+
+class TraceRecordStore {
+public:
+    static constexpr size_t c_defaultSpillThreshold = 1 << 20;
+
+    explicit TraceRecordStore(size_t spillThreshold = c_defaultSpillThreshold);
+
+    TraceRecordStore(TraceRecordStore&& other) noexcept;
+    TraceRecordStore& operator=(TraceRecordStore&& other) noexcept;
+
+    // Thread-safe; records may arrive in any order.
+    void Append(const TraceRecord& record);
+
+    // Thread-safe; ORs TraceRecordFlags into an appended record.
+    void AddFlags(int id, uint8_t flags);
+
+    // Thread-safe; narrows an appended record to bytes [offset, offset + count) of its operand.
+    void SetByteRange(int id, uint16_t offset, uint16_t count);
+
+    // Builds the child index. Children are ordered by id.
+    void Finalize();
+
+    size_t Size() const { return m_count; }
+    int GetMaxId() const { return (int)m_parentIds.size() - 1; }
+    bool Contains(int id) const { return id > 0 && id <= GetMaxId() && m_parentIds[id] != c_noRecord; }
+    bool IsSpilled() const { return m_parentIds.IsSpilled(); }
+
+    int GetParentId(int id) const { return m_parentIds[id]; }
+    int GetRefId(int id) const { return m_refIds[id]; }
+    uint8_t GetFlags(int id) const { return m_flags[id]; }
+    TracePosition GetPosition(int id) const;
+    TraceRecord Get(int id) const;
+
+    // Ids of the records whose parentId is 'parentId'; empty before Finalize().
+    std::span<const uint32_t> GetChildren(int parentId) const;
+
+    // Bytes held in memory, mapped columns excluded.
+    size_t GetMemoryUsage() const;
+
+    void Clear();
+
+private:
+    static constexpr int32_t c_noRecord = -1;
+    static constexpr int32_t c_widePosition = INT32_MIN;
+    static constexpr unsigned c_blockShift = 6;
+    static constexpr uint64_t c_noSequence = UINT64_MAX;
+
+    void SetPosition(int id, TracePosition pos);
+
+    std::mutex m_mutex;
+    size_t m_count = 0;
+
+    SpillableArray<int32_t> m_parentIds;      // c_noRecord for ids that were never appended
+    SpillableArray<int32_t> m_refIds;
+    SpillableArray<uint8_t> m_flags;
+    SpillableArray<int32_t> m_sequenceDeltas; // Sequence - block base, c_widePosition: see m_widePositions
+    SpillableArray<uint32_t> m_steps;
+
+    std::vector<uint64_t> m_blockSequences;   // base sequence of each block of 1 << c_blockShift ids
+    std::unordered_map<int, TracePosition> m_widePositions;
+    std::unordered_map<int, std::pair<uint16_t, uint16_t>> m_byteRanges; // only split memory nodes have one
+
+    std::vector<uint32_t> m_childOffsets;     // parentId -> first entry in m_children, size maxId + 2
+    std::vector<uint32_t> m_children;
+};
@@ -0,0 +1,118 @@
+// TraceSource.h
+//
+// Portable view of a trace for the tracking engine in TrackEngine.h. It covers everything the
+// engine asks of a trace: the last write of a location before a position, the locations an
+// instruction reads and writes, the thread and stack it runs on, and every write of a window for
+// the last-writer index. ReplayTraceSource implements it on a TTD cursor; SyntheticTrace
+// implements it in memory, so the engine builds, runs and is tested without WinDbg.
+//
+// Nothing in here may depend on Windows, dbgeng or the TTD headers.
+#pragma once
+
+#include <compare>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class QueryBudget;
+
+// Mirrors TTD::Replay::Position: a sequence id plus the steps executed since it.
+struct TracePosition {
+    uint64_t sequence = UINT64_MAX;
+    uint64_t steps = UINT64_MAX;
+
+    static constexpr TracePosition Min() { return { 0, 0 }; }
+
+    bool IsValid() const { return sequence != UINT64_MAX; }
+
+    auto operator<=>(TracePosition const&) const = default;
+};
+
+enum class TraceLocationType : uint8_t {
+    Register,
+    Memory,
+};
+
+// A register (ZydisRegister value) or a memory range. Registers read by an instruction are already
+// reduced to the register they are tracked as; only a root may name a sub-register such as al.
+struct TraceLocation {
+    TraceLocationType type = TraceLocationType::Register;
+    uint32_t reg = 0;
+    uint64_t address = 0;
+    uint32_t size = 0;
+
+    static TraceLocation Register(uint32_t reg, uint32_t size) { return { TraceLocationType::Register, reg, 0, size }; }
+    static TraceLocation Memory(uint64_t address, uint32_t size) { return { TraceLocationType::Memory, 0, address, size }; }
+
+    bool IsMemory() const { return type == TraceLocationType::Memory; }
+
+    bool operator==(TraceLocation const&) const = default;
+};
+
+// One location of a FindMemoryWrites batch; the write must be strictly before pos.
+struct MemoryWriteQuery {
+    uint64_t address = 0;
+    uint64_t size = 0;
+    TracePosition pos;
+    TracePosition result; // position of the write, invalid if none was found
+};
+
+// The register whose writes a register is searched among, and the bytes of it the register
+// occupies: al is { rax, 0x0001 }, ah { rax, 0x0002 }, eax { rax, 0x000f }.
+struct TrackedRegister {
+    uint32_t reg = 0;
+    uint16_t bytes = 0xffff;
+};
+
+// Receives the writes of ITraceSource::CollectWrites. Returning false stops the collection.
+class ITraceWriteSink {
+public:
+    virtual ~ITraceWriteSink() = default;
+
+    // 'reg' is a tracked register (see TrackedRegister), 'bytes' the part of it the write covers.
+    virtual bool AddRegisterWrite(uint32_t thread, uint32_t reg, uint16_t bytes, TracePosition pos) = 0;
+    virtual bool AddMemoryWrite(uint64_t address, uint64_t size, TracePosition pos) = 0;
+};
+
+class ITraceSource {
+public:
+    virtual ~ITraceSource() = default;
+
+    // Position of the instruction that last wrote 'reg' on the thread of 'pos', strictly before 'pos'.
+    // With stopAtDefinition that is the first instruction that writes every byte of the register,
+    // otherwise the first one that changes its value. Invalid when there is no such write, or when
+    // 'budget' ran out or its window ended first; the budget records which.
+    virtual TracePosition FindRegisterWrite(uint32_t reg, TracePosition pos, bool stopAtDefinition, QueryBudget* budget) = 0;
+
+    // Last write of any byte of [address, address + size) strictly before 'pos'. currentThreadOnly
+    // looks at the thread of 'pos' only, for memory no other thread writes (its stack).
+    virtual TracePosition FindMemoryWrite(uint64_t address, uint64_t size, TracePosition pos, QueryBudget* budget, bool currentThreadOnly) = 0;
+
+    // Answers several memory queries with one search; unanswered queries keep an invalid result.
+    virtual void FindMemoryWrites(std::vector<MemoryWriteQuery>& queries, QueryBudget* budget, bool currentThreadOnly) = 0;
+
+    // The call that entered the function executing at 'pos'; invalid when it is not in the trace.
+    virtual TracePosition FindFrameEntry(TracePosition pos, QueryBudget* budget) = 0;
+
+    // Appends the locations the instruction at 'pos' reads to compute what it writes.
+    virtual void GetReads(TracePosition pos, std::vector<TraceLocation>& reads) = 0;
+
+    // Appends the memory ranges the instruction at 'pos' writes; none when they are unknown.
+    virtual void GetMemoryWrites(TracePosition pos, std::vector<TraceLocation>& writes) = 0;
+
+    virtual uint32_t GetThreadId(TracePosition pos) = 0;
+
+    // True when [address, address + size) lies on the stack of the thread running at 'pos'.
+    virtual bool IsThreadStack(uint64_t address, uint64_t size, TracePosition pos) = 0;
+
+    // Program counter and disassembly of the instruction at 'pos', for display.
+    virtual uint64_t GetProgramCounter(TracePosition pos) = 0;
+    virtual std::string GetInstructionText(TracePosition pos) = 0;
+
+    virtual TrackedRegister GetTrackedRegister(uint32_t reg) = 0;
+
+    // Walks backward from 'pos' over every thread, at most windowSteps steps (0 = to the start of the
+    // trace), and reports every register and memory write to 'sink', newest first. 'windowStart' is
+    // where the walk stopped. Returns true when that is the start of the trace.
+    virtual bool CollectWrites(TracePosition pos, uint64_t windowSteps, ITraceWriteSink& sink, TracePosition& windowStart) = 0;
+};
@@ -0,0 +1,507 @@
+// TrackBench.cpp
+//
+// Benchmark of the backtracking engine on generated traces. Every workload is built into a
+// SyntheticTrace from a fixed seed, so two runs of the same build see the same trace and the
+// same tree, and tracked from its last step with RunTrackWorkers, the code _TimeTrack runs on a
+// recording. Each config switches on one hot path: memory batching, the work-stealing workers,
+// the last-writer index, a warm writer cache, lookback windows, -bytes splitting and spilled
+// record columns. The default config is also run at several maxSteps limits. DecodeCache decodes
+// with Zydis on a TTD cursor and is not part of this build; ReplayTraceSource is the only user.
+//
+//   trackbench [-length:n] [-seed:n] [-repeat:n] [-workload:name] [-config:name]
+//
+// A lookup is a write search, a batch of memory items counts once; cached is the share answered
+// by the writer cache or the index without a replay. Replay steps per query is the distance a
+// backward replay would cover for each search that did replay: from the query position back to the write, or to the window or trace
+// start when there is none. Tree MB is what the TraceRecordStore holds in memory after Finalize,
+// walk is one depth-first pass over its child index. RSS is the resident memory right after a
+// row's runs; the peak of the whole process is printed once at the end. A full run finishes with
+// the register name lookup of GetRegisterByName against the hash map it replaced.
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "PerfectNameHash.h"
+#include "SyntheticTrace.h"
+#include "TrackEngine.h"
+#include "TrackStats.h"
+
+namespace {
+
+// Register ids only have to be distinct; these follow the x64 numbering for readability.
+enum : uint32_t {
+    c_rax = 1, c_rcx, c_rdx, c_rbx, c_rsp, c_rbp, c_rsi, c_rdi,
+    c_r8, c_r9, c_r10, c_r11, c_r12, c_r13, c_r14, c_r15,
+};
+
+constexpr uint64_t c_heapBase = 0x10000000;
+constexpr uint64_t c_noiseBase = 0x20000000;
+constexpr uint64_t c_stackTop = 0x7ff00000;
+
+TraceLocation Reg(uint32_t reg) { return TraceLocation::Register(reg, 8); }
+TraceLocation Mem(uint64_t address) { return TraceLocation::Memory(address, 8); }
+
+// Appends steps to a trace. Noise steps touch only r8-r15 and their own heap region, so they
+// lengthen the distance between a read and its write without joining the tracked tree.
+class TraceBuilder {
+public:
+    TraceBuilder(SyntheticTrace& trace, uint64_t seed) : m_trace(trace), m_random(seed) {}
+
+    TracePosition Step(std::vector<TraceLocation> reads, std::vector<TraceLocation> writes) {
+        SyntheticTrace::Step step;
+        step.thread = 1;
+        step.pc = 0x140001000 + (m_pc++ % 0x4000) * 4;
+        step.reads = std::move(reads);
+        step.writes = std::move(writes);
+        return m_trace.AddStep(std::move(step));
+    }
+
+    void Noise(size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            uint32_t src = c_r8 + (uint32_t)(m_random() % 8);
+            uint32_t dst = c_r8 + (uint32_t)(m_random() % 8);
+            uint64_t slot = c_noiseBase + (m_random() % 4096) * 8;
+            if (m_random() % 2) {
+                Step({ Reg(src), Mem(slot) }, { Reg(dst) });
+            }
+            else {
+                Step({ Reg(src) }, { Mem(slot) });
+            }
+        }
+    }
+
+    size_t NoiseBetween() { return (size_t)(m_random() % 8); }
+    std::mt19937_64& Random() { return m_random; }
+
+private:
+    SyntheticTrace& m_trace;
+    std::mt19937_64 m_random;
+    uint64_t m_pc = 0;
+};
+
+struct Workload {
+    const char* name;
+    const char* description;
+    // Fills the trace with about 'length' steps and returns the location to track from its end.
+    std::function<TraceLocation(TraceBuilder&, size_t)> build;
+};
+
+// mov [rdi+8], rbx for every node of a shuffled list, then rax = [rax+8] down the whole list.
+TraceLocation BuildPointerChain(TraceBuilder& b, size_t length)
+{
+    size_t nodes = std::max<size_t>(length / 8, 1);
+
+    std::vector<uint64_t> addresses(nodes + 1);
+    for (size_t i = 0; i < addresses.size(); i++) addresses[i] = c_heapBase + i * 64;
+    std::shuffle(addresses.begin() + 1, addresses.end(), b.Random());
+
+    for (size_t i = 0; i < nodes; i++) {
+        b.Step({}, { Reg(c_rbx) });
+        b.Step({}, { Reg(c_rdi) });
+        b.Step({ Reg(c_rdi), Reg(c_rbx) }, { Mem(addresses[i] + 8) });
+        b.Noise(b.NoiseBetween());
+    }
+
+    b.Step({}, { Reg(c_rax) });
+    for (size_t i = 0; i < nodes; i++) {
+        b.Step({ Reg(c_rax), Mem(addresses[i] + 8) }, { Reg(c_rax) });
+        b.Noise(b.NoiseBetween());
+    }
+
+    return Reg(c_rax);
+}
+
+// A pairwise sum over an array: every level reads two slots of the level below. The leaves are
+// computed from a shared counter, so most of the bottom of the tree are back-references.
+TraceLocation BuildFanIn(TraceBuilder& b, size_t length)
+{
+    size_t leaves = 1;
+    while (leaves * 4 < length) leaves *= 2;
+
+    uint64_t level = c_heapBase;
+    b.Step({}, { Reg(c_rcx) });
+    for (size_t i = 0; i < leaves; i++) {
+        b.Step({ Reg(c_rcx) }, { Reg(c_rcx) });
+        b.Step({ Reg(c_rcx), Reg(c_rdx) }, { Mem(level + i * 8) });
+        b.Noise(b.NoiseBetween());
+    }
+
+    for (size_t width = leaves / 2; width >= 1; width /= 2) {
+        uint64_t next = level + width * 2 * 8;
+        for (size_t i = 0; i < width; i++) {
+            b.Step({ Mem(level + i * 16), Mem(level + i * 16 + 8) }, { Mem(next + i * 8) });
+            b.Noise(b.NoiseBetween());
+        }
+        level = next;
+    }
+
+    return Mem(level);
+}
+
+// Fills a source buffer, then copies it qword by qword with rsi/rdi stepping through both.
+TraceLocation BuildMemcpy(TraceBuilder& b, size_t length)
+{
+    size_t qwords = std::max<size_t>(length / 8, 1);
+    uint64_t src = c_heapBase;
+    uint64_t dst = c_heapBase + qwords * 8 + 0x1000;
+
+    b.Step({}, { Reg(c_rax) });
+    for (size_t i = 0; i < qwords; i++) {
+        b.Step({ Reg(c_rax) }, { Reg(c_rax) });
+        b.Step({ Reg(c_rax) }, { Mem(src + i * 8) });
+    }
+    b.Noise(b.NoiseBetween());
+
+    b.Step({}, { Reg(c_rsi) });
+    b.Step({}, { Reg(c_rdi) });
+    for (size_t i = 0; i < qwords; i++) {
+        b.Step({ Reg(c_rsi), Mem(src + i * 8) }, { Reg(c_rcx) });
+        b.Step({ Reg(c_rdi), Reg(c_rcx) }, { Mem(dst + i * 8) });
+        b.Step({ Reg(c_rsi) }, { Reg(c_rsi) });
+        b.Step({ Reg(c_rdi) }, { Reg(c_rdi) });
+    }
+
+    return Mem(dst + (qwords - 1) * 8);
+}
+
+// The same frame entered over and over: push rbx/rsi, spill and reload rax, pop. Every
+// iteration writes the same stack slots, so the write lists of those granules grow with the trace.
+TraceLocation BuildStackSpills(TraceBuilder& b, size_t length)
+{
+    size_t calls = std::max<size_t>(length / 12, 1);
+    uint64_t sp = c_stackTop;
+
+    b.Step({}, { Reg(c_rsp) });
+    b.Step({}, { Reg(c_rax) });
+    b.Step({}, { Reg(c_rbx) });
+    for (size_t i = 0; i < calls; i++) {
+        b.Step({ Reg(c_rsp), Reg(c_rbx) }, { Mem(sp - 8), Reg(c_rsp) });
+        b.Step({ Reg(c_rsp), Reg(c_rsi) }, { Mem(sp - 16), Reg(c_rsp) });
+        b.Step({ Reg(c_rsp), Reg(c_rax) }, { Mem(sp - 24) });
+        b.Step({ Reg(c_rbx), Reg(c_rsi) }, { Reg(c_rbx) });
+        b.Noise(b.NoiseBetween());
+        b.Step({ Reg(c_rsp), Mem(sp - 24) }, { Reg(c_rax) });
+        b.Step({ Reg(c_rax), Reg(c_rbx) }, { Reg(c_rax) });
+        b.Step({ Reg(c_rsp), Mem(sp - 16) }, { Reg(c_rsi), Reg(c_rsp) });
+        b.Step({ Reg(c_rsp), Mem(sp - 8) }, { Reg(c_rbx), Reg(c_rsp) });
+    }
+
+    return Reg(c_rax);
+}
+
+const Workload c_workloads[] = {
+    { "pointer", "deep pointer chain", BuildPointerChain },
+    { "fanin", "wide arithmetic fan-in", BuildFanIn },
+    { "memcpy", "memcpy loop", BuildMemcpy },
+    { "spill", "stack-spill-heavy frames", BuildStackSpills },
+};
+
+// Resident memory of the process now, so every row shows what its own tree costs.
+size_t GetCurrentMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.WorkingSetSize;
+#else
+    unsigned long long pages = 0, resident = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm) return 0;
+    if (fscanf(statm, "%llu %llu", &pages, &resident) != 2) resident = 0;
+    fclose(statm);
+    return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+size_t GetPeakMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+double Megabytes(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+// Engine settings a row runs with; each one switches on the hot path it is named after.
+struct EngineConfig {
+    const char* name;
+    const char* description;
+    void (*apply)(TimeTrackOptions& options);
+    bool warmCache = false; // the timed run starts from the writer cache of an untimed one
+};
+
+const EngineConfig c_configs[] = {
+    { "default", "1 worker, cold writer cache, memory batches of 16", [](TimeTrackOptions&) {} },
+    { "nobatch", "one replay per memory item", [](TimeTrackOptions& o) { o.memoryBatchSize = 1; } },
+    { "jobs4", "4 workers on the work-stealing queues", [](TimeTrackOptions& o) { o.workerCount = 4; } },
+    { "index", "last-writer index built before the run", [](TimeTrackOptions& o) { o.useWriterIndex = true; } },
+    { "warm", "writer cache filled by a previous run", [](TimeTrackOptions&) {}, true },
+    { "window", "4096-step lookback window", [](TimeTrackOptions& o) { o.windowSteps = 4096; } },
+    { "bytes", "memory split on partial writes", [](TimeTrackOptions& o) { o.splitMemory = true; } },
+    { "spill", "records spilled to mapped files", [](TimeTrackOptions& o) { o.spillThreshold = 4096; } },
+};
+
+struct RunResult {
+    double seconds = 0;
+    uint64_t searches = 0;  // write searches that replayed
+    uint64_t answers = 0;   // searches answered by the writer cache or the index
+    uint64_t replaySteps = 0;
+};
+
+// One _TimeTrack run: the index (with -index), the workers and the child index of the records.
+RunResult RunEngine(SyntheticTrace& trace, const TraceLocation& root, TracePosition end, const TimeTrackOptions& options,
+    LastWriterCache& writerCache, TraceRecordStore& records, int maxSteps)
+{
+    RunResult result;
+    TrackBudget budget(options);
+    LastWriterIndex writerIndex;
+    g_TrackStats.Reset();
+
+    // Searches only read the trace, so every worker can share it; on a recording each has its own cursor.
+    std::vector<ITraceSource*> sources(options.workerCount, &trace);
+
+    auto start = std::chrono::steady_clock::now();
+    if (options.useWriterIndex) writerIndex.Build(trace, end, options.indexWindowSteps);
+
+    TrackSession session(options, budget, writerIndex, writerCache, records, maxSteps);
+    WorkItem rootItem = session.AddRoot(trace, root, end);
+    RunTrackWorkers(session, rootItem, sources);
+    records.Finalize();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result.searches = g_TrackStats.Get(TrackCounter::RegisterQueries) + g_TrackStats.Get(TrackCounter::MemoryQueries);
+    result.answers = g_TrackStats.Get(TrackCounter::CacheAnswers) + g_TrackStats.Get(TrackCounter::IndexAnswers);
+    result.replaySteps = g_TrackStats.Get(TrackCounter::ReplaySteps);
+    return result;
+}
+
+// Visits the whole tree through the child index, the way the tree view and the printer walk it.
+size_t WalkTree(const TraceRecordStore& records, size_t& refs)
+{
+    size_t visited = 0;
+    refs = 0;
+    std::vector<int> stack;
+    if (records.Contains(1)) stack.push_back(1);
+
+    while (!stack.empty()) {
+        int id = stack.back();
+        stack.pop_back();
+        visited++;
+        if (records.GetRefId(id) != 0) refs++;
+        for (uint32_t child : records.GetChildren(id)) stack.push_back((int)child);
+    }
+    return visited;
+}
+
+// Most of the names GetRegisterByName resolves, without the Zydis ids.
+constexpr std::string_view c_registerNames[] = {
+    "al", "cl", "dl", "bl", "ah", "ch", "dh", "bh", "spl", "bpl", "sil", "dil",
+    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b",
+    "ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+    "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w",
+    "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+    "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d",
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",
+    "st0", "st1", "st2", "st3", "st4", "st5", "st6", "st7",
+    "mm0", "mm1", "mm2", "mm3", "mm4", "mm5", "mm6", "mm7",
+    "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+    "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15",
+    "ymm0", "ymm1", "ymm2", "ymm3", "ymm4", "ymm5", "ymm6", "ymm7",
+    "ymm8", "ymm9", "ymm10", "ymm11", "ymm12", "ymm13", "ymm14", "ymm15",
+    "zmm0", "zmm1", "zmm2", "zmm3", "zmm4", "zmm5", "zmm6", "zmm7",
+    "zmm8", "zmm9", "zmm10", "zmm11", "zmm12", "zmm13", "zmm14", "zmm15",
+    "k0", "k1", "k2", "k3", "k4", "k5", "k6", "k7",
+    "flags", "eflags", "rflags", "ip", "eip", "rip", "es", "cs", "ss", "ds", "fs", "gs", "mxcsr",
+    "efl", "segcs", "segds", "seges", "segfs", "seggs", "segss",
+};
+
+// Same table shape as disasm_helper.cpp.
+constexpr PerfectNameHash<std::size(c_registerNames), 128, 512> c_registerNameTable(c_registerNames);
+
+// Time per lookup of the perfect hash against the lowercase-and-hash-map lookup it replaced, on a
+// mix of names as users type them: lowercase, uppercase and a few that are not registers.
+void BenchNameLookup(uint64_t seed, unsigned int repeat)
+{
+    std::vector<std::string> queries;
+    for (std::string_view name : c_registerNames) {
+        std::string upper(name);
+        for (char& c : upper) c = (char)toupper((unsigned char)c);
+        queries.emplace_back(name);
+        queries.push_back(upper);
+    }
+    for (const char* miss : { "rax1", "xmm32", "foo", "r16", "", "eflagz" }) queries.emplace_back(miss);
+    std::shuffle(queries.begin(), queries.end(), std::mt19937_64(seed));
+
+    std::unordered_map<std::string, int> map;
+    for (size_t i = 0; i < std::size(c_registerNames); i++) map.emplace(c_registerNames[i], (int)i);
+
+    constexpr size_t c_lookups = 4000000;
+
+    auto time = [&](auto find) {
+        double best = 0;
+        long long checksum = 0;
+        for (unsigned int run = 0; run < repeat; run++) {
+            checksum = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < c_lookups; i++) checksum += find(queries[i % queries.size()]);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (run == 0 || seconds < best) best = seconds;
+        }
+        return std::make_pair(best * 1e9 / c_lookups, checksum);
+    };
+
+    auto [perfectNs, perfectSum] = time([](const std::string& name) { return c_registerNameTable.Find(name); });
+    auto [mapNs, mapSum] = time([&](const std::string& name) {
+        std::string lower(name);
+        for (char& c : lower) c = (char)tolower((unsigned char)c);
+        auto it = map.find(lower);
+        return it != map.end() ? it->second : -1;
+    });
+
+    printf("\nregister name lookup, %zu names, %zu queries\n", std::size(c_registerNames), queries.size());
+    printf("  perfect hash   %6.1f ns\n", perfectNs);
+    printf("  unordered_map  %6.1f ns%s\n", mapNs, perfectSum == mapSum ? "" : "  (results differ)");
+}
+
+struct BenchOptions {
+    size_t length = 100000;
+    uint64_t seed = 1;
+    unsigned int repeat = 3;
+    std::string workload;
+    std::string config;
+};
+
+// Parses one "-name:value" switch, like the !timetrack options. Returns false for unknown switches.
+bool ParseBenchOption(const std::string& token, BenchOptions& options)
+{
+    size_t sep = token.find(':');
+    if (token.size() < 2 || token[0] != '-' || sep == std::string::npos) return false;
+
+    std::string name = token.substr(1, sep - 1);
+    std::string value = token.substr(sep + 1);
+    if (value.empty()) return false;
+
+    if (name == "length") options.length = std::stoull(value, nullptr, 0);
+    else if (name == "seed") options.seed = std::stoull(value, nullptr, 0);
+    else if (name == "repeat") options.repeat = std::max(1ul, std::stoul(value, nullptr, 0));
+    else if (name == "workload") options.workload = value;
+    else if (name == "config") options.config = value;
+    else return false;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        if (!ParseBenchOption(argv[i], options)) {
+            printf("Usage: trackbench [-length:n] [-seed:n] [-repeat:n] [-workload:name] [-config:name]\n");
+            printf("Workloads:\n");
+            for (const Workload& workload : c_workloads) {
+                printf("  %-8s %s\n", workload.name, workload.description);
+            }
+            printf("Configs:\n");
+            for (const EngineConfig& config : c_configs) {
+                printf("  %-8s %s\n", config.name, config.description);
+            }
+            return 1;
+        }
+    }
+
+    // Only the default config is run at every limit; the others compare against its "all" row.
+    const size_t maxStepsList[] = { 100, 1000, 10000, 0 };
+
+    printf("length %zu, seed %llu, best of %u\n", options.length, (unsigned long long)options.seed, options.repeat);
+
+    for (const Workload& workload : c_workloads) {
+        if (!options.workload.empty() && options.workload != workload.name) continue;
+
+        SyntheticTrace trace;
+        TraceBuilder builder(trace, options.seed);
+        TraceLocation root = workload.build(builder, options.length);
+        TracePosition end = builder.Step({}, {});
+
+        printf("\n%s: %s, %zu steps, trace %.1f MB\n", workload.name, workload.description, trace.GetStepCount(), Megabytes(trace.GetMemoryUsage()));
+        printf("%-8s %8s %10s %12s %7s %12s %9s %8s %9s %8s %9s\n",
+            "config", "maxSteps", "lookups", "lookups/s", "cached", "replay/query", "nodes", "refs", "tree MB", "walk ms", "RSS MB");
+
+        for (const EngineConfig& config : c_configs) {
+            if (!options.config.empty() && options.config != config.name) continue;
+
+            for (size_t maxSteps : maxStepsList) {
+                if (maxSteps != 0 && strcmp(config.name, "default") != 0) continue;
+                int maxStepsLimit = maxSteps == 0 ? INT_MAX : (int)maxSteps;
+
+                TimeTrackOptions trackOptions;
+                config.apply(trackOptions);
+
+                RunResult best;
+                TraceRecordStore records(trackOptions.spillThreshold);
+
+                for (unsigned int run = 0; run < options.repeat; run++) {
+                    LastWriterCache writerCache;
+                    if (config.warmCache) {
+                        TraceRecordStore warmup(trackOptions.spillThreshold);
+                        RunEngine(trace, root, end, trackOptions, writerCache, warmup, maxStepsLimit);
+                    }
+
+                    records = TraceRecordStore(trackOptions.spillThreshold);
+                    RunResult result = RunEngine(trace, root, end, trackOptions, writerCache, records, maxStepsLimit);
+                    if (run == 0 || result.seconds < best.seconds) best = result;
+                }
+
+                auto walkStart = std::chrono::steady_clock::now();
+                size_t refs = 0;
+                size_t walked = WalkTree(records, refs);
+                double walkSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - walkStart).count();
+
+                char limit[32];
+                if (maxSteps == 0) strcpy(limit, "all");
+                else snprintf(limit, sizeof(limit), "%zu", maxSteps);
+
+                uint64_t lookups = best.searches + best.answers;
+                printf("%-8s %8s %10llu %12.0f %6.1f%% %12.1f %9zu %8zu %9.2f %8.2f %9.1f%s\n",
+                    config.name, limit, (unsigned long long)lookups,
+                    best.seconds > 0 ? lookups / best.seconds : 0.0,
+                    lookups ? 100.0 * best.answers / lookups : 0.0,
+                    best.searches ? (double)best.replaySteps / best.searches : 0.0,
+                    records.Size(), refs,
+                    Megabytes(records.GetMemoryUsage()), walkSeconds * 1000,
+                    Megabytes(GetCurrentMemory()),
+                    walked == records.Size() ? "" : "  (tree not connected)");
+            }
+        }
+    }
+
+    if (options.workload.empty() && options.config.empty()) BenchNameLookup(options.seed, options.repeat);
+
+    printf("\npeak MB %.1f\n", Megabytes(GetPeakMemory()));
+    return 0;
+}
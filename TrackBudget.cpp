@@ -0,0 +1,108 @@
+#include "TrackBudget.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "TrackEngine.h"
+
+TrackBudget::TrackBudget(const TimeTrackOptions& options)
+    : m_start(Clock::now()),
+      m_lastProgress(Clock::now()),
+      m_maxReplaySteps(options.replayStepBudget),
+      m_queryTimeMs(options.queryTimeMs),
+      m_querySteps(options.queryStepBudget)
+{
+    if (options.timeBudgetMs != 0) {
+        m_deadline = m_start + std::chrono::milliseconds(options.timeBudgetMs);
+    }
+}
+
+bool TrackBudget::IsStopped() const
+{
+    if (m_cancelled || m_interrupted) return true;
+    if (Clock::now() >= m_deadline) return true;
+    if (m_maxReplaySteps != 0 && m_replaySteps >= m_maxReplaySteps) return true;
+    return false;
+}
+
+uint64_t TrackBudget::GetRemainingSteps() const
+{
+    if (m_maxReplaySteps == 0) return UINT64_MAX;
+    uint64_t used = m_replaySteps;
+    return used >= m_maxReplaySteps ? 0 : m_maxReplaySteps - used;
+}
+
+std::string TrackBudget::TakeProgressLine()
+{
+    Clock::time_point now = Clock::now();
+    if (now - m_lastProgress < c_progressInterval) return {};
+    m_lastProgress = now;
+
+    double seconds = std::chrono::duration<double>(now - m_start).count();
+    char line[160];
+    snprintf(line, sizeof(line), "timetrack: %.1f%% through the trace, %d items, %llu replay steps, %.1f s\n",
+        (double)m_percent, (int)m_items, (unsigned long long)m_replaySteps, seconds);
+    return line;
+}
+
+const char* TrackBudget::GetStopReason() const
+{
+    if (m_interrupted) return "interrupted by Ctrl+Break";
+    if (m_cancelled) return "cancelled";
+    if (Clock::now() >= m_deadline) return "time budget exhausted";
+    if (m_maxReplaySteps != 0 && m_replaySteps >= m_maxReplaySteps) return "replay step budget exhausted";
+    return nullptr;
+}
+
+QueryBudget::QueryBudget(TrackBudget& track, uint64_t windowSteps, TracePosition windowStart)
+    : m_track(track), m_deadline(track.GetDeadline()), m_maxSteps(track.GetQuerySteps()),
+      m_windowSteps(windowSteps), m_windowStart(windowStart)
+{
+    if (track.GetQueryTimeMs() != 0) {
+        m_deadline = std::min(m_deadline, TrackBudget::Clock::now() + std::chrono::milliseconds(track.GetQueryTimeMs()));
+    }
+}
+
+uint64_t QueryBudget::NextChunk() const
+{
+    uint64_t chunk = std::min(c_replayChunk, m_track.GetRemainingSteps());
+    if (m_maxSteps != 0) {
+        chunk = std::min(chunk, m_steps >= m_maxSteps ? 0 : m_maxSteps - m_steps);
+    }
+    if (m_windowSteps != 0) {
+        chunk = std::min(chunk, m_steps >= m_windowSteps ? 0 : m_windowSteps - m_steps);
+    }
+    return chunk;
+}
+
+void QueryBudget::AddSteps(uint64_t steps)
+{
+    m_steps += steps;
+    m_track.AddSteps(steps);
+}
+
+bool QueryBudget::ShouldInterrupt() const
+{
+    return TrackBudget::Clock::now() >= m_deadline || m_track.IsStopped();
+}
+
+bool QueryBudget::Charge(uint64_t distance)
+{
+    for (uint64_t charged = 0; charged < distance;) {
+        if (IsWindowFull()) {
+            MarkOutsideWindow();
+            return false;
+        }
+
+        uint64_t chunk = NextChunk();
+        if (chunk == 0 || ShouldInterrupt()) {
+            MarkExhausted();
+            return false;
+        }
+
+        chunk = std::min(chunk, distance - charged);
+        AddSteps(chunk);
+        charged += chunk;
+    }
+    return true;
+}
@@ -0,0 +1,113 @@
+// TrackBudget.h
+//
+// Wall-clock and replay-step limits for one !timetrack run (TrackBudget) and for each write
+// search in it (QueryBudget), plus cancellation and the progress line. A search that runs out
+// of budget ends like a miss but is marked exhausted, so its result is not cached and the records
+// found so far are kept. Portable: Ctrl+Break is polled by the thread that owns the debug client,
+// which calls Interrupt().
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "TraceSource.h"
+
+struct TimeTrackOptions;
+
+class TrackBudget {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Limits of 0 are unlimited.
+    explicit TrackBudget(const TimeTrackOptions& options);
+
+    // True once the run is cancelled, interrupted or out of time or steps.
+    bool IsStopped() const;
+    void Cancel() { m_cancelled = true; }
+    void Interrupt() { m_interrupted = true; }
+
+    void AddSteps(uint64_t steps) { m_replaySteps += steps; }
+    uint64_t GetReplaySteps() const { return m_replaySteps; }
+    uint64_t GetRemainingSteps() const;
+
+    Clock::time_point GetDeadline() const { return m_deadline; }
+    uint64_t GetQueryTimeMs() const { return m_queryTimeMs; }
+    uint64_t GetQuerySteps() const { return m_querySteps; }
+
+    // Progress line, at most once per c_progressInterval; empty in between. Called by one thread only.
+    void ReportProgress(double percent) { m_percent = percent; }
+    void SetItemCount(int items) { m_items = items; }
+    std::string TakeProgressLine();
+
+    // Why the run stopped early, nullptr when it was not cut short.
+    const char* GetStopReason() const;
+
+private:
+    static constexpr std::chrono::seconds c_progressInterval{ 1 };
+
+    Clock::time_point m_start;
+    Clock::time_point m_deadline = Clock::time_point::max();
+    Clock::time_point m_lastProgress;
+
+    uint64_t m_maxReplaySteps = 0;
+    uint64_t m_queryTimeMs = 0;
+    uint64_t m_querySteps = 0;
+
+    std::atomic<uint64_t> m_replaySteps{ 0 };
+    std::atomic<bool> m_cancelled{ false };
+    std::atomic<bool> m_interrupted{ false };
+    std::atomic<double> m_percent{ 0.0 };
+    std::atomic<int> m_items{ 0 };
+};
+
+class QueryBudget {
+public:
+    // The lookback window of the query: at most windowSteps replayed steps (0 = unlimited) and
+    // nothing before windowStart. Reaching either ends the query as "not found within window".
+    explicit QueryBudget(TrackBudget& track, uint64_t windowSteps = 0, TracePosition windowStart = TracePosition::Min());
+
+    void SetWindowStart(TracePosition windowStart) { m_windowStart = windowStart; }
+    TracePosition GetWindowStart() const { return m_windowStart; }
+
+    // Where the search stopped: the write it found, or the oldest position it reached.
+    void SetStopPosition(TracePosition pos) { m_stopPosition = pos; }
+    TracePosition GetStopPosition() const { return m_stopPosition; }
+
+    // Steps the next replay chunk may take, 0 when the query is out of budget.
+    uint64_t NextChunk() const;
+    void AddSteps(uint64_t steps);
+    uint64_t GetSteps() const { return m_steps; }
+
+    // Checked from the replay progress callback.
+    bool ShouldInterrupt() const;
+
+    // For sources that know how far a search goes without replaying: charges 'distance' steps in
+    // chunks, as a replay would. False when the budget or the step window runs out first; the
+    // query is marked exhausted or outside the window then.
+    bool Charge(uint64_t distance);
+
+    void MarkExhausted() { m_exhausted = true; }
+    bool IsExhausted() const { return m_exhausted; }
+
+    void MarkOutsideWindow() { m_outsideWindow = true; }
+    bool IsOutsideWindow() const { return m_outsideWindow; }
+    bool IsWindowFull() const { return m_windowSteps != 0 && m_steps >= m_windowSteps; }
+
+    TrackBudget& GetTrack() { return m_track; }
+
+private:
+    static constexpr uint64_t c_replayChunk = 1000000;
+
+    TrackBudget& m_track;
+    TrackBudget::Clock::time_point m_deadline;
+    uint64_t m_maxSteps = 0;
+    uint64_t m_windowSteps = 0;
+    uint64_t m_steps = 0;
+    TracePosition m_windowStart = TracePosition::Min();
+    TracePosition m_stopPosition;
+    bool m_exhausted = false;
+    bool m_outsideWindow = false;
+};
+
@@ -0,0 +1,432 @@
+#include "TrackEngine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <optional>
+#include <thread>
+
+#include "ByteRangeSet.h"
+#include "TrackStats.h"
+#include "WorkStealingQueue.h"
+
+// Memory work items whose positions are at most this many sequences apart may share a replay.
+static constexpr uint64_t c_batchSequenceSpan = 256;
+
+// How often the calling thread flushes the output and polls while the workers run.
+static constexpr std::chrono::milliseconds c_coordinatorInterval{ 10 };
+
+int TrackSession::ClaimDefinition(const WorkItem& item, TracePosition pos)
+{
+    uint64_t location = item.location.IsMemory() ? item.location.address : (uint64_t)item.location.reg;
+    uint64_t size = item.location.IsMemory() ? item.location.size : 0;
+
+    std::lock_guard<std::mutex> lock(definitionsMutex);
+    return definitions.try_emplace({ location, size, pos }, item.id).first->second;
+}
+
+void TrackSession::WriteRecord(const TraceRecord& record, ITraceSource& source)
+{
+    records.Append(record);
+    if (output) output->Add(record, source);
+    g_TrackStats.Add(TrackCounter::Records);
+
+    uint64_t pc = source.GetProgramCounter(record.pos);
+    std::lock_guard<std::mutex> lock(pcsMutex);
+    pcs.insert(pc);
+}
+
+WorkItem TrackSession::AddRoot(ITraceSource& source, const TraceLocation& location, TracePosition pos)
+{
+    WorkItem rootItem;
+    rootItem.id = NextId();
+    rootItem.location = location;
+    rootItem.pos = pos;
+
+    TraceRecord rootRecord = {};
+    rootRecord.id = rootItem.id;
+    rootRecord.pos = pos;
+    WriteRecord(rootRecord, source);
+
+    return rootItem;
+}
+
+// -bytes: the write at 'foundPos' may cover only part of a memory item. The item then keeps the bytes
+// it covers and every gap becomes a sibling item, read by the same instruction, that is searched on
+// its own.
+static void SplitMemoryItem(TrackSession& session, ITraceSource& source, const WorkItem& item, TracePosition foundPos, std::vector<WorkItem>& newItems)
+{
+    // Byte ranges are recorded in 16 bits; an operand that large is kept whole.
+    if ((uint64_t)item.byteOffset + item.location.size > UINT16_MAX) return;
+
+    std::vector<TraceLocation> writes;
+    source.GetMemoryWrites(foundPos, writes);
+
+    uint64_t start = item.location.address;
+    uint64_t end = item.location.address + item.location.size;
+
+    ByteRangeSet covered;
+    for (const TraceLocation& write : writes) {
+        if (!write.IsMemory()) continue;
+        covered.Add(std::max(write.address, start), std::min(write.address + write.size, end));
+    }
+
+    // No write operand lands in the item (segment-relative, opaque instructions): keep it whole.
+    if (covered.IsEmpty()) return;
+
+    std::vector<std::pair<uint64_t, uint64_t>> gaps = covered.GetGaps(start, end);
+    if (gaps.empty()) return;
+
+    session.records.SetByteRange(item.id, (uint16_t)(item.byteOffset + covered.GetStart() - start), (uint16_t)(covered.GetEnd() - covered.GetStart()));
+
+    // The gap records belong to the instruction that reads 'item'. The search that found 'foundPos'
+    // already passed every step after it without a write to the gaps, so theirs start there.
+    for (const auto& [gapStart, gapEnd] : gaps) {
+        WorkItem gap = item;
+        gap.id = session.NextId();
+        gap.pos = foundPos;
+        gap.location = TraceLocation::Memory(gapStart, (uint32_t)(gapEnd - gapStart));
+        gap.byteOffset = (uint16_t)(item.byteOffset + gapStart - start);
+
+        TraceRecord record = {};
+        record.id = gap.id;
+        record.parentId = item.parentId;
+        record.pos = item.pos;
+        record.byteOffset = gap.byteOffset;
+        record.byteCount = (uint16_t)gap.location.size;
+        session.WriteRecord(record, source);
+
+        newItems.push_back(gap);
+    }
+}
+
+// Appends a new item for every location read by the instruction at 'foundPos', the write that
+// defines 'item'.
+static void ExpandWorkItem(TrackSession& session, ITraceSource& source, const WorkItem& item, TracePosition foundPos, std::vector<WorkItem>& newItems)
+{
+    // Shared definitions are expanded once; later paths get a back-reference to that subtree.
+    // The owner is the only one that splits, so the gaps of a shared write are searched once too.
+    int ownerId = session.ClaimDefinition(item, foundPos);
+    if (ownerId != item.id) {
+        TraceRecord record = {};
+        record.id = session.NextId();
+        record.parentId = item.id;
+        record.pos = foundPos;
+        record.refId = ownerId;
+        session.WriteRecord(record, source);
+        return;
+    }
+
+    if (session.options.splitMemory && item.location.IsMemory()) {
+        SplitMemoryItem(session, source, item, foundPos, newItems);
+    }
+
+    std::vector<TraceLocation> reads;
+    source.GetReads(foundPos, reads);
+
+    for (const TraceLocation& read : reads) {
+        TraceRecord record = {};
+        record.id = session.NextId();
+        record.parentId = item.id;
+        record.pos = foundPos;
+        session.WriteRecord(record, source);
+
+        WorkItem newItem;
+        newItem.id = record.id;
+        newItem.parentId = item.id;
+        newItem.location = read;
+        newItem.pos = foundPos;
+        newItems.push_back(newItem);
+    }
+}
+
+// Resolves one work item on 'source' and expands the write that defines it.
+// Runs concurrently on the scheduler's workers, one source each.
+static void ProcessWorkItem(TrackSession& session, ITraceSource& source, const WorkItem& item, std::vector<WorkItem>& newItems, TimelineEvent* event)
+{
+    const TraceLocation& location = item.location;
+
+    TracePosition foundPos;
+    TracePosition searchPos = item.pos;
+    bool answered = false;
+
+    uint32_t threadId = source.GetThreadId(item.pos);
+    // The index records definitions, so with -index every register search is a definition search
+    // and the cache key always matches the search that produced the result.
+    bool definitions = session.options.exactRegisterDefs || session.options.useWriterIndex;
+    bool threadLocal = session.IsThreadLocal(source, item);
+
+    if (!location.IsMemory()) {
+        answered = session.writerCache.FindRegisterWrite(threadId, location.reg, definitions, item.pos, foundPos);
+    }
+    else {
+        answered = session.writerCache.FindMemoryWrite(location.address, location.size, item.pos, foundPos, threadLocal ? &threadId : nullptr);
+    }
+
+    if (answered) {
+        g_TrackStats.Add(TrackCounter::CacheAnswers);
+        if (event) event->answer = TimelineAnswer::Cache;
+    }
+    else if (session.writerIndex.Covers(item.pos)) {
+        if (!location.IsMemory()) {
+            foundPos = session.writerIndex.FindRegisterWrite(threadId, source.GetTrackedRegister(location.reg), item.pos);
+        }
+        else {
+            foundPos = session.writerIndex.FindMemoryWrite(location.address, location.size, item.pos);
+        }
+
+        answered = foundPos.IsValid() || session.writerIndex.ReachesTraceStart();
+
+        if (answered) {
+            g_TrackStats.Add(TrackCounter::IndexAnswers);
+            if (event) event->answer = TimelineAnswer::Index;
+        }
+        else if (location.IsMemory()) {
+            // Not written inside the window, continue the search from where the index stops.
+            // That position may be on another thread, so the search covers all of them.
+            searchPos = session.writerIndex.GetWindowStart();
+            threadLocal = false;
+        }
+    }
+
+    if (!answered) {
+        QueryBudget query(session.budget, session.options.windowSteps);
+
+        if (session.options.frameWindow) {
+            // The frame is the one executing at the item, wherever the index left the search.
+            TracePosition frameEntry = source.FindFrameEntry(item.pos, &query);
+            if (frameEntry.IsValid()) query.SetWindowStart(frameEntry);
+        }
+
+        if (!location.IsMemory()) {
+            g_TrackStats.Add(TrackCounter::RegisterQueries);
+            foundPos = source.FindRegisterWrite(location.reg, searchPos, definitions, &query);
+        }
+        else {
+            g_TrackStats.Add(TrackCounter::MemoryQueries);
+            foundPos = source.FindMemoryWrite(location.address, location.size, searchPos, &query, threadLocal);
+        }
+
+        if (event) {
+            event->answer = TimelineAnswer::Replay;
+            event->windowEnd = query.GetStopPosition();
+        }
+
+        // A search cut short by the budget or the window is not a real miss.
+        if (query.IsExhausted()) return;
+
+        if (query.IsOutsideWindow()) {
+            session.records.AddFlags(item.id, TraceRecordOutsideWindow);
+            session.windowMisses++;
+            return;
+        }
+
+        if (!location.IsMemory()) {
+            session.writerCache.AddRegisterWrite(threadId, location.reg, definitions, item.pos, foundPos);
+        }
+        else {
+            // A search of one thread cannot answer later searches of all threads.
+            session.writerCache.AddMemoryWrite(location.address, location.size, item.pos, foundPos, threadLocal ? &threadId : nullptr);
+        }
+    }
+
+    if (event && event->answer != TimelineAnswer::Replay) event->windowEnd = foundPos;
+    if (!foundPos.IsValid()) return;
+
+    ExpandWorkItem(session, source, item, foundPos, newItems);
+}
+
+// Resolves a batch of memory work items with one FindMemoryWrites search, then expands each.
+// Used for runs of memory items at nearby positions, typically siblings from one instruction.
+static void ProcessMemoryBatch(TrackSession& session, ITraceSource& source, const std::vector<WorkItem>& items, std::vector<WorkItem>& newItems, TimelineEvent* event)
+{
+    std::vector<TracePosition> found(items.size());
+
+    std::vector<MemoryWriteQuery> queries;
+    std::vector<size_t> owners;
+
+    // The batch searches a single thread only if every location is on the stack of that thread.
+    bool threadLocal = true;
+    std::optional<uint32_t> batchThread;
+
+    for (size_t i = 0; i < items.size(); i++) {
+        const WorkItem& item = items[i];
+        uint32_t threadId = source.GetThreadId(item.pos);
+        bool itemLocal = session.IsThreadLocal(source, item);
+
+        if (!session.writerCache.FindMemoryWrite(item.location.address, item.location.size, item.pos, found[i], itemLocal ? &threadId : nullptr)) {
+            queries.push_back({ item.location.address, item.location.size, item.pos });
+            owners.push_back(i);
+
+            threadLocal = threadLocal && itemLocal && (!batchThread || *batchThread == threadId);
+            batchThread = threadId;
+        }
+        else {
+            g_TrackStats.Add(TrackCounter::CacheAnswers);
+        }
+    }
+
+    if (event && queries.empty()) event->answer = TimelineAnswer::Cache;
+
+    if (!queries.empty()) {
+        QueryBudget query(session.budget, session.options.windowSteps);
+        g_TrackStats.Add(TrackCounter::MemoryQueries);
+        source.FindMemoryWrites(queries, &query, threadLocal);
+
+        if (event) {
+            event->answer = TimelineAnswer::Replay;
+            event->windowEnd = query.GetStopPosition();
+        }
+
+        for (size_t j = 0; j < queries.size(); j++) {
+            const WorkItem& item = items[owners[j]];
+            TracePosition result = queries[j].result;
+
+            // Unanswered queries of a batch cut short are not real misses.
+            if (!result.IsValid() && query.IsExhausted()) continue;
+
+            if (!result.IsValid() && query.IsOutsideWindow()) {
+                session.records.AddFlags(item.id, TraceRecordOutsideWindow);
+                session.windowMisses++;
+                continue;
+            }
+
+            session.writerCache.AddMemoryWrite(item.location.address, item.location.size, item.pos, result, threadLocal ? &*batchThread : nullptr);
+            found[owners[j]] = result;
+        }
+    }
+
+    for (size_t i = 0; i < items.size(); i++) {
+        if (!found[i].IsValid()) continue;
+        ExpandWorkItem(session, source, items[i], found[i], newItems);
+    }
+}
+
+// Positions close enough for one backward search to serve both work items.
+static bool IsNearbyPosition(TracePosition a, TracePosition b)
+{
+    return (a.sequence > b.sequence ? a.sequence - b.sequence : b.sequence - a.sequence) <= c_batchSequenceSpan;
+}
+
+// With a single worker the items are processed in the same breadth-first order as a plain queue.
+void RunTrackWorkers(TrackSession& session, const WorkItem& rootItem, const std::vector<ITraceSource*>& sources, const std::function<void()>& poll)
+{
+    size_t workerCount = sources.size();
+    std::vector<WorkStealingQueue<WorkItem>> queues(workerCount);
+
+    // Batches need one search over every item; the per-item index and frame windows do not mix with that.
+    size_t batchSize = session.options.memoryBatchSize;
+    if (session.options.useWriterIndex || session.options.frameWindow) batchSize = 1;
+
+    // Items queued or in flight; the run is over when it drops to zero.
+    std::atomic<int> pending{ 1 };
+    queues[0].Push(rootItem);
+
+    auto worker = [&](size_t self) {
+        std::vector<WorkItem> newItems;
+        std::vector<WorkItem> batch;
+
+        while (!session.stop) {
+            std::optional<WorkItem> item = queues[self].Pop();
+            for (size_t i = 1; !item && i < workerCount; i++) {
+                item = queues[(self + i) % workerCount].Steal();
+            }
+
+            if (session.budget.IsStopped()) {
+                session.stop = true;
+                break;
+            }
+
+            if (!item) {
+                if (pending == 0) break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            if (session.steps.fetch_add(1) >= session.maxSteps) {
+                session.stop = true;
+                break;
+            }
+
+            // Memory items queued right behind this one at nearby positions share its search.
+            batch.assign(1, *item);
+            if (batchSize > 1 && item->location.IsMemory()) {
+                int room = session.maxSteps - session.steps;
+                size_t extra = room > 0 ? std::min(batchSize - 1, (size_t)room) : 0;
+
+                std::vector<WorkItem> more = queues[self].PopWhile([&](const WorkItem& next) {
+                    return next.location.IsMemory() && IsNearbyPosition(item->pos, next.pos);
+                }, extra);
+
+                session.steps += (int)more.size();
+                batch.insert(batch.end(), more.begin(), more.end());
+            }
+
+            TimelineEvent event;
+            TimelineEvent* timelineEvent = nullptr;
+            if (session.timeline) {
+                event.itemId = item->id;
+                event.itemCount = batch.size();
+                event.memory = item->location.IsMemory();
+                event.windowStart = item->pos;
+                event.start = std::chrono::steady_clock::now();
+                timelineEvent = &event;
+            }
+
+            newItems.clear();
+            try {
+                if (batch.size() > 1) {
+                    ProcessMemoryBatch(session, *sources[self], batch, newItems, timelineEvent);
+                }
+                else {
+                    ProcessWorkItem(session, *sources[self], *item, newItems, timelineEvent);
+                }
+            }
+            catch (...) {
+                // An exception must not escape a worker thread; the item just ends its branch.
+                newItems.clear();
+            }
+
+            if (timelineEvent) {
+                event.end = std::chrono::steady_clock::now();
+                session.timeline->Add(self, event);
+            }
+
+            pending += (int)newItems.size();
+            for (const WorkItem& newItem : newItems) {
+                queues[self].Push(newItem);
+            }
+            pending -= (int)batch.size();
+        }
+    };
+
+    // The last worker to finish wakes the coordinator, so a short run does not wait out the interval.
+    std::mutex finishedMutex;
+    std::condition_variable finishedSignal;
+    size_t finished = 0;
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < workerCount; i++) {
+        threads.emplace_back([&, i]() {
+            worker(i);
+            std::lock_guard<std::mutex> lock(finishedMutex);
+            if (++finished == workerCount) finishedSignal.notify_one();
+        });
+    }
+
+    for (;;) {
+        if (session.budget.IsStopped()) session.stop = true;
+        if (session.output) session.output->Flush(false);
+        session.budget.SetItemCount(session.steps);
+        if (poll) poll();
+
+        std::unique_lock<std::mutex> lock(finishedMutex);
+        if (finishedSignal.wait_for(lock, c_coordinatorInterval, [&] { return finished == workerCount; })) break;
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (session.output) session.output->Flush(true);
+}
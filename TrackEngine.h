@@ -0,0 +1,117 @@
+// TrackEngine.h
+//
+// The backtracking engine of _TimeTrack. Each work item is a location read at a position; it is
+// resolved to the instruction that last wrote it (write search cache, last-writer index or a search
+// of the trace), and the locations that instruction reads become new work items. A (location,
+// writer) pair reached again becomes a back-reference to the item that expanded it first.
+//
+// Everything it asks of the trace goes through ITraceSource, so the same code runs on TTD cursors
+// (ReplayTraceSource) inside the extension and on SyntheticTrace in the tests and trackbench.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
+
+#include "LastWriterCache.h"
+#include "LastWriterIndex.h"
+#include "TraceRecordStore.h"
+#include "TraceSource.h"
+#include "TrackBudget.h"
+#include "TrackTimeline.h"
+
+// Switches parsed from the !timetrack command line
+struct TimeTrackOptions {
+    bool useWriterIndex = false;    // -index[:steps] answer work items from a LastWriterIndex
+    uint64_t indexWindowSteps = 0;  // steps replayed to build the index, 0 = to the start of the trace or LastWriterIndex::c_maxWrites
+    bool exactRegisterDefs = false; // -exactdefs  stop at register writes that keep the same value
+    unsigned int workerCount = 1;   // -jobs[:n]   cursors replaying work items in parallel
+    bool streamOutput = false;      // -stream     print every node as soon as it is found
+    uint64_t timeBudgetMs = 0;      // -time:ms    wall-clock budget of the whole run, 0 = unlimited
+    uint64_t replayStepBudget = 0;  // -steps:n    replay steps of the whole run, 0 = unlimited
+    uint64_t queryTimeMs = 0;       // -qtime:ms   wall-clock budget of one write search
+    uint64_t queryStepBudget = 0;   // -qsteps:n   replay steps of one write search
+    uint64_t windowSteps = 0;       // -window:n   lookback window of each write search in steps
+    bool frameWindow = false;       // -window:frame  lookback window ends at the current function's entry
+    bool allThreadMemory = false;   // -allthreads replay every thread for stack memory too
+    size_t memoryBatchSize = 16;    // -batch:n    memory work items resolved by one replay
+    bool splitMemory = false;       // -bytes      split memory locations on partial writes, one origin per byte range
+    std::string timelinePath;       // -timeline:file  write a Chrome trace-event timeline of the work items
+    bool persistCache = false;      // -persist    keep write search results in <trace>.ttcache across sessions
+    size_t spillThreshold = TraceRecordStore::c_defaultSpillThreshold; // -spill:n   records kept in memory before spilling to a mapped file
+};
+
+struct WorkItem {
+    int parentId = 0; // The ID of the TraceRecord that spawned this work item
+    int id = 0;
+    TraceLocation location;
+    uint16_t byteOffset = 0; // offset of location.address in the operand the item was split from (-bytes)
+    TracePosition pos;
+};
+
+// Receives every record as it is written (-stream). Add is called by the workers, Flush only by
+// the thread that runs RunTrackWorkers.
+class ITrackOutput {
+public:
+    virtual ~ITrackOutput() = default;
+
+    virtual void Add(const TraceRecord& record, ITraceSource& source) = 0;
+    virtual void Flush(bool final) = 0;
+};
+
+// State shared by every worker of one _TimeTrack run.
+struct TrackSession {
+    TrackSession(const TimeTrackOptions& options, TrackBudget& budget, const LastWriterIndex& writerIndex, LastWriterCache& writerCache, TraceRecordStore& records, int maxSteps)
+        : options(options), budget(budget), writerIndex(writerIndex), writerCache(writerCache), records(records), maxSteps(maxSteps) {}
+
+    const TimeTrackOptions& options;
+    TrackBudget& budget;
+    const LastWriterIndex& writerIndex;
+    LastWriterCache& writerCache;
+
+    TraceRecordStore& records;
+    ITrackOutput* output = nullptr;
+    TrackTimeline* timeline = nullptr;
+
+    int maxSteps;
+    std::atomic<int> steps{ 0 };
+    std::atomic<bool> stop{ false };
+    std::atomic<int> idCounter{ 0 };
+    std::atomic<int> windowMisses{ 0 };
+
+    // (location, size, defining position) -> id of the item that expands it. Registers have size 0.
+    std::mutex definitionsMutex;
+    std::map<std::tuple<uint64_t, uint64_t, TracePosition>, int> definitions;
+
+    // Every PC that got a record, for the symbol prefetch once the run is over.
+    std::mutex pcsMutex;
+    std::unordered_set<uint64_t> pcs;
+
+    // True when only the thread running at the item can have written its memory.
+    bool IsThreadLocal(ITraceSource& source, const WorkItem& item) {
+        if (options.allThreadMemory || !item.location.IsMemory()) return false;
+        return source.IsThreadStack(item.location.address, item.location.size, item.pos);
+    }
+
+    int NextId() { return idCounter.fetch_add(1, std::memory_order_relaxed) + 1; }
+
+    // Returns the id of the item that owns the definition at 'pos', which is 'item' unless
+    // another path reached the same location and definition first.
+    int ClaimDefinition(const WorkItem& item, TracePosition pos);
+
+    void WriteRecord(const TraceRecord& record, ITraceSource& source);
+
+    // Writes the root record for 'location' read at 'pos' and returns its work item.
+    WorkItem AddRoot(ITraceSource& source, const TraceLocation& location, TracePosition pos);
+};
+
+// Processes work items until the queues drain or maxSteps items have been processed, one worker
+// thread per source. The calling thread only coordinates: every c_coordinatorInterval it flushes
+// session.output and calls 'poll', which prints progress and checks for Ctrl+Break.
+void RunTrackWorkers(TrackSession& session, const WorkItem& rootItem, const std::vector<ITraceSource*>& sources, const std::function<void()>& poll = {});
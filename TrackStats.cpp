@@ -0,0 +1,91 @@
+#include "TrackStats.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+
+// Phase timers and counters of the last run, see !ttstats.
+TrackStats g_TrackStats;
+
+void TrackStats::AddReplayDistance(uint64_t steps)
+{
+    size_t bucket = std::min<size_t>((size_t)std::bit_width(steps), c_distanceBuckets - 1);
+    m_distances[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max = m_maxDistance.load(std::memory_order_relaxed);
+    while (max < steps && !m_maxDistance.compare_exchange_weak(max, steps, std::memory_order_relaxed)) {}
+}
+
+const char* TrackStats::GetName(TrackPhase phase)
+{
+    switch (phase) {
+        case TrackPhase::Track: return "track";
+        case TrackPhase::Replay: return "replay";
+        case TrackPhase::Context: return "context";
+        case TrackPhase::Decode: return "decode";
+        case TrackPhase::Symbol: return "symbol";
+        case TrackPhase::Output: return "output";
+        default: return "?";
+    }
+}
+
+const char* TrackStats::GetName(TrackCounter counter)
+{
+    switch (counter) {
+        case TrackCounter::RegisterQueries: return "registerQueries";
+        case TrackCounter::MemoryQueries: return "memoryQueries";
+        case TrackCounter::CacheAnswers: return "cacheAnswers";
+        case TrackCounter::IndexAnswers: return "indexAnswers";
+        case TrackCounter::ReplaySteps: return "replaySteps";
+        case TrackCounter::Records: return "records";
+        default: return "?";
+    }
+}
+
+void TrackStats::Reset()
+{
+    for (PhaseTime& time : m_phases) {
+        time.calls.store(0, std::memory_order_relaxed);
+        time.nanoseconds.store(0, std::memory_order_relaxed);
+    }
+    for (auto& counter : m_counters) counter.store(0, std::memory_order_relaxed);
+    for (auto& bucket : m_distances) bucket.store(0, std::memory_order_relaxed);
+    m_maxDistance.store(0, std::memory_order_relaxed);
+}
+
+// {"phases":{"track":{"calls":1,"ms":12.5},...},"counters":{...},"replayDistance":{"max":n,"buckets":[{"from":0,"count":n},...]}}
+// Empty histogram buckets are left out.
+std::string TrackStats::ToJson() const
+{
+    char buffer[128];
+
+    std::string json = "{\"phases\":{";
+    for (size_t i = 0; i < (size_t)TrackPhase::Count; i++) {
+        TrackPhase phase = (TrackPhase)i;
+        snprintf(buffer, sizeof(buffer), "%s\"%s\":{\"calls\":%llu,\"ms\":%.3f}", i ? "," : "", GetName(phase),
+            (unsigned long long)GetCalls(phase), GetNanoseconds(phase) / 1e6);
+        json += buffer;
+    }
+
+    json += "},\"counters\":{";
+    for (size_t i = 0; i < (size_t)TrackCounter::Count; i++) {
+        TrackCounter counter = (TrackCounter)i;
+        snprintf(buffer, sizeof(buffer), "%s\"%s\":%llu", i ? "," : "", GetName(counter), (unsigned long long)Get(counter));
+        json += buffer;
+    }
+
+    snprintf(buffer, sizeof(buffer), "},\"replayDistance\":{\"max\":%llu,\"buckets\":[", (unsigned long long)GetMaxDistance());
+    json += buffer;
+    bool first = true;
+    for (size_t i = 0; i < c_distanceBuckets; i++) {
+        uint64_t count = GetDistanceCount(i);
+        if (count == 0) continue;
+        snprintf(buffer, sizeof(buffer), "%s{\"from\":%llu,\"count\":%llu}", first ? "" : ",",
+            (unsigned long long)GetBucketStart(i), (unsigned long long)count);
+        json += buffer;
+        first = false;
+    }
+    json += "]}}";
+
+    return json;
+}
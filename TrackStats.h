@@ -0,0 +1,101 @@
+// TrackStats.h
+//
+// Low-overhead instrumentation of the !timetrack hot paths: time spent per phase, event counters
+// and a histogram of how far each write search replayed. Everything is a relaxed atomic, so the
+// workers update it without locks. Reset at the start of every _TimeTrack run and read by !ttstats.
+//
+// Phases nest: Replay includes the watchpoint callbacks, which decode and read contexts, Output
+// includes the symbol lookups of the printer, and Track is the whole run except the final output.
+// Only the cache misses of Decode and Symbol are timed.
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class TrackPhase : uint8_t {
+    Track,      // the whole _TimeTrack run
+    Replay,     // ReplayBackward of write searches and of the last-writer index
+    Context,    // full register context fetches
+    Decode,     // Zydis decoding and formatting of uncached instructions
+    Symbol,     // dbgeng symbol lookups of uncached program counters
+    Output,     // DML output of the tree, streamed or printed after the run
+    Count
+};
+
+enum class TrackCounter : uint8_t {
+    RegisterQueries,    // register write searches that replayed
+    MemoryQueries,      // memory write searches that replayed, a batch counts once
+    CacheAnswers,       // searches answered by the write search cache
+    IndexAnswers,       // searches answered by the last-writer index
+    ReplaySteps,        // steps replayed by write searches
+    Records,            // records written
+    Count
+};
+
+class TrackStats {
+public:
+    // Bucket 0 counts searches that replayed no step, bucket i > 0 those of [2^(i-1), 2^i) steps.
+    static constexpr size_t c_distanceBuckets = 48;
+
+    void AddTime(TrackPhase phase, uint64_t nanoseconds) {
+        PhaseTime& time = m_phases[(size_t)phase];
+        time.calls.fetch_add(1, std::memory_order_relaxed);
+        time.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+
+    void Add(TrackCounter counter, uint64_t value = 1) {
+        m_counters[(size_t)counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    // One write search that replayed 'steps' steps.
+    void AddReplayDistance(uint64_t steps);
+
+    uint64_t GetCalls(TrackPhase phase) const { return m_phases[(size_t)phase].calls.load(std::memory_order_relaxed); }
+    uint64_t GetNanoseconds(TrackPhase phase) const { return m_phases[(size_t)phase].nanoseconds.load(std::memory_order_relaxed); }
+    uint64_t Get(TrackCounter counter) const { return m_counters[(size_t)counter].load(std::memory_order_relaxed); }
+    uint64_t GetDistanceCount(size_t bucket) const { return m_distances[bucket].load(std::memory_order_relaxed); }
+    uint64_t GetMaxDistance() const { return m_maxDistance.load(std::memory_order_relaxed); }
+
+    // Smallest distance that falls into 'bucket'.
+    static uint64_t GetBucketStart(size_t bucket) { return bucket == 0 ? 0 : 1ull << (bucket - 1); }
+
+    static const char* GetName(TrackPhase phase);
+    static const char* GetName(TrackCounter counter);
+
+    void Reset();
+    std::string ToJson() const;
+
+private:
+    struct PhaseTime {
+        std::atomic<uint64_t> calls{ 0 };
+        std::atomic<uint64_t> nanoseconds{ 0 };
+    };
+
+    std::array<PhaseTime, (size_t)TrackPhase::Count> m_phases;
+    std::array<std::atomic<uint64_t>, (size_t)TrackCounter::Count> m_counters{};
+    std::array<std::atomic<uint64_t>, c_distanceBuckets> m_distances{};
+    std::atomic<uint64_t> m_maxDistance{ 0 };
+};
+
+extern TrackStats g_TrackStats;
+
+// Adds the lifetime of the scope to a phase of g_TrackStats.
+class ScopedPhaseTimer {
+public:
+    explicit ScopedPhaseTimer(TrackPhase phase) : m_phase(phase), m_start(std::chrono::steady_clock::now()) {}
+    ~ScopedPhaseTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - m_start;
+        g_TrackStats.AddTime(m_phase, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+    ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+
+private:
+    TrackPhase m_phase;
+    std::chrono::steady_clock::time_point m_start;
+};
@@ -0,0 +1,86 @@
+#include "TrackStream.h"
+
+#include <format>
+
+#include "Formatters.h"
+#include "SymbolCache.h"
+#include "TrackStats.h"
+
+TrackStream::TrackStream(IDebugClient* client)
+    : m_control(client), m_symbols(client)
+{
+}
+
+void TrackStream::Add(const TraceRecord& record, ITraceSource& source)
+{
+    Line line;
+    line.record = record;
+    line.pc = source.GetProgramCounter(record.pos);
+    line.instruction = source.GetInstructionText(record.pos);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending.emplace(record.id, std::move(line));
+}
+
+void TrackStream::Flush(bool final)
+{
+    if (!m_control || !m_symbols) return;
+
+    std::lock_guard<std::mutex> outputLock(m_outputMutex);
+
+    std::vector<Line> ready;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        size_t readyCount = 0;
+        for (auto it = m_pending.begin(); it != m_pending.end() && it->first == m_nextId + (int)readyCount; ++it) {
+            readyCount++;
+        }
+        if (final) readyCount = m_pending.size();
+
+        if (readyCount == 0) return;
+        if (!final && readyCount < c_batchLines && std::chrono::steady_clock::now() - m_lastOutput < c_flushInterval) return;
+
+        for (size_t i = 0; i < readyCount; i++) {
+            auto it = m_pending.begin();
+            m_nextId = it->first + 1;
+            ready.push_back(std::move(it->second));
+            m_pending.erase(it);
+        }
+    }
+
+    ScopedPhaseTimer timer(TrackPhase::Output);
+    std::string output;
+
+    for (const Line& line : ready) {
+        const TraceRecord& record = line.record;
+
+        if (m_depths.size() <= (size_t)record.id) {
+            m_depths.resize((size_t)record.id + 1, 0);
+        }
+        int depth = 0;
+        if (record.parentId > 0 && (size_t)record.parentId < m_depths.size()) {
+            depth = m_depths[record.parentId] + 1;
+        }
+        m_depths[record.id] = depth;
+
+        output.append(depth, '-');
+        output += std::format("#{}", record.id);
+        if (record.parentId != 0) output += std::format(" <- #{}", record.parentId);
+        if (record.refId != 0) output += std::format(" => #{}", record.refId);
+        if (record.byteCount != 0) output += std::format(" (bytes {}-{})", record.byteOffset, record.byteOffset + record.byteCount - 1);
+        output += "\t";
+
+        output += std::format("<exec cmd=\"!tt {}\">{}</exec>\t", record.pos, record.pos);
+
+        SymbolName symbol = g_SymbolCache.Get(m_symbols, line.pc);
+        output += std::format("{}+{:X}", symbol.name, symbol.displacement);
+        output += "\t";
+
+        output += line.instruction;
+        output += "\n";
+    }
+
+    m_control->ControlledOutput(DEBUG_OUTCTL_THIS_CLIENT | DEBUG_OUTCTL_DML, DEBUG_OUTPUT_NORMAL, "%s", output.c_str());
+    m_lastOutput = std::chrono::steady_clock::now();
+}
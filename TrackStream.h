@@ -0,0 +1,53 @@
+// TrackStream.h
+//
+// Streaming output for !timetrack -stream. Workers queue a line for every record as soon as it
+// is written; Flush() prints the queued lines in id order, so the output does not depend on
+// which worker finished first, and batches them into one ControlledOutput call. Symbols are
+// resolved in Flush(), which must run on the thread that owns the debug client; _TimeTrack
+// calls it on a timer from that thread while the workers run.
+#pragma once
+#include "stdafx.h"
+
+#include <Windows.h>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <DbgEng.h>
+#include <atlcomcli.h>
+#include "TrackEngine.h"
+
+class TrackStream : public ITrackOutput {
+public:
+    explicit TrackStream(IDebugClient* client);
+
+    // Thread-safe.
+    void Add(const TraceRecord& record, ITraceSource& source) override;
+
+    // Prints the lines that are next in id order. Small batches are held back until
+    // c_flushInterval has passed since the last output. 'final' prints everything left.
+    void Flush(bool final = false) override;
+
+private:
+    struct Line {
+        TraceRecord record;
+        uint64_t pc = 0;
+        std::string instruction;
+    };
+
+    static constexpr size_t c_batchLines = 64;
+    static constexpr std::chrono::milliseconds c_flushInterval{ 100 };
+
+    CComQIPtr<IDebugControl> m_control;
+    CComQIPtr<IDebugSymbols3> m_symbols;
+
+    std::mutex m_mutex;         // m_pending, m_nextId
+    std::mutex m_outputMutex;   // m_depths, m_lastOutput; held for a whole Flush
+    std::map<int, Line> m_pending;
+    int m_nextId = 1;
+
+    std::vector<int> m_depths; // by id
+    std::chrono::steady_clock::time_point m_lastOutput = std::chrono::steady_clock::now();
+};
@@ -0,0 +1,277 @@
+// TrackTests.cpp
+//
+// Tree-shape tests of the backtracking engine. Each test builds a small SyntheticTrace, tracks a
+// location from its last step with RunTrackWorkers, exactly as _TimeTrack does on a recording, and
+// checks the records. A record sits at the step that reads its location, so the children of a
+// record sit at the step that writes it.
+//
+//   tracktests        runs every test, exits with 1 when a check fails
+#include <climits>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+#include "SyntheticTrace.h"
+#include "TrackEngine.h"
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            g_failures++; \
+        } \
+    } while (0)
+
+enum : uint32_t {
+    c_rax = 1, c_rcx, c_rdx, c_rbx,
+    c_eax, c_ax, c_al, c_ah,
+};
+
+constexpr uint64_t c_heapBase = 0x10000000;
+
+TraceLocation Reg(uint32_t reg) { return TraceLocation::Register(reg, 8); }
+TraceLocation Mem(uint64_t address, uint32_t size = 8) { return TraceLocation::Memory(address, size); }
+
+TracePosition AddStep(SyntheticTrace& trace, std::vector<TraceLocation> reads, std::vector<TraceLocation> writes, uint32_t thread = 1)
+{
+    SyntheticTrace::Step step;
+    step.thread = thread;
+    step.pc = 0x140001000 + trace.GetStepCount() * 4;
+    step.reads = std::move(reads);
+    step.writes = std::move(writes);
+    return trace.AddStep(std::move(step));
+}
+
+void AddSubRegisters(SyntheticTrace& trace)
+{
+    trace.SetSubRegister(c_eax, c_rax, 0x000f);
+    trace.SetSubRegister(c_ax, c_rax, 0x0003);
+    trace.SetSubRegister(c_al, c_rax, 0x0001);
+    trace.SetSubRegister(c_ah, c_rax, 0x0002);
+}
+
+// Tracks 'root' read at the last step of 'trace' and returns the finalized records.
+TraceRecordStore Track(SyntheticTrace& trace, const TraceLocation& root, TimeTrackOptions options = {}, size_t spillThreshold = TraceRecordStore::c_defaultSpillThreshold)
+{
+    TraceRecordStore records(spillThreshold);
+    TrackBudget budget(options);
+    LastWriterCache writerCache;
+
+    TracePosition end = { trace.GetStepCount() - 1, 0 };
+
+    LastWriterIndex writerIndex;
+    if (options.useWriterIndex) {
+        writerIndex.Build(trace, end, options.indexWindowSteps);
+    }
+
+    std::vector<ITraceSource*> sources;
+    for (unsigned int i = 0; i < options.workerCount; i++) sources.push_back(&trace);
+
+    TrackSession session(options, budget, writerIndex, writerCache, records, INT_MAX);
+    WorkItem rootItem = session.AddRoot(trace, root, end);
+    RunTrackWorkers(session, rootItem, sources);
+
+    records.Finalize();
+    return records;
+}
+
+std::vector<int> Children(const TraceRecordStore& records, int id)
+{
+    std::vector<int> children;
+    for (uint32_t child : records.GetChildren(id)) children.push_back((int)child);
+    return children;
+}
+
+// The only child of 'id', 0 when it has none or several.
+int OnlyChild(const TraceRecordStore& records, int id)
+{
+    std::vector<int> children = Children(records, id);
+    return children.size() == 1 ? children[0] : 0;
+}
+
+size_t CountRefs(const TraceRecordStore& records)
+{
+    size_t refs = 0;
+    for (int id = 1; id <= records.GetMaxId(); id++) {
+        if (records.Contains(id) && records.GetRefId(id) != 0) refs++;
+    }
+    return refs;
+}
+
+// rbx is defined once and read by two instructions whose results are added: the second path to
+// that definition becomes a back-reference to the first.
+void TestBackReference(unsigned int workerCount, size_t spillThreshold)
+{
+    SyntheticTrace trace;
+    TracePosition defineRbx = AddStep(trace, {}, { Reg(c_rbx) });
+    TracePosition copyToRax = AddStep(trace, { Reg(c_rbx) }, { Reg(c_rax) });
+    TracePosition copyToRcx = AddStep(trace, { Reg(c_rbx) }, { Reg(c_rcx) });
+    TracePosition add = AddStep(trace, { Reg(c_rax), Reg(c_rcx) }, { Reg(c_rdx) });
+    TracePosition end = AddStep(trace, { Reg(c_rdx) }, {});
+
+    TimeTrackOptions options;
+    options.workerCount = workerCount;
+    TraceRecordStore records = Track(trace, Reg(c_rdx), options, spillThreshold);
+
+    // #1 rdx, written by the add that reads rax and rcx; both were copied from rbx.
+    CHECK(records.Size() == 6);
+    CHECK(records.GetPosition(1) == end);
+    CHECK(CountRefs(records) == 1);
+
+    std::vector<int> reads = Children(records, 1);
+    CHECK(reads.size() == 2);
+    if (reads.size() != 2) return;
+
+    int ownerId = 0;
+    int refId = 0;
+    for (int read : reads) {
+        CHECK(records.GetPosition(read) == add);
+
+        int rbxRead = OnlyChild(records, read);
+        CHECK(rbxRead != 0);
+        if (rbxRead == 0) continue;
+
+        TracePosition copy = records.GetPosition(rbxRead);
+        CHECK(copy == copyToRax || copy == copyToRcx);
+
+        std::vector<int> below = Children(records, rbxRead);
+        if (below.empty()) {
+            ownerId = rbxRead; // the definition of rbx reads nothing
+        }
+        else {
+            CHECK(below.size() == 1);
+            refId = records.GetRefId(below[0]);
+            CHECK(records.GetPosition(below[0]) == defineRbx);
+            CHECK(Children(records, below[0]).empty());
+        }
+    }
+
+    CHECK(ownerId != 0);
+    CHECK(refId == ownerId);
+    CHECK(spillThreshold > records.Size() || records.IsSpilled());
+}
+
+// al and ah are different bytes of rax: a write of ah is not the writer of al, a write of ax is
+// found from either, and an ah search passes a write of al to reach the eax that covers it.
+void TestSubRegisters(bool useWriterIndex)
+{
+    SyntheticTrace trace;
+    AddSubRegisters(trace);
+
+    TracePosition writeAl = AddStep(trace, { Reg(c_rbx) }, { Reg(c_al) });
+    TracePosition writeAh = AddStep(trace, { Reg(c_rdx) }, { Reg(c_ah) });
+    TracePosition readAl = AddStep(trace, { Reg(c_al) }, { Reg(c_rcx) });
+    TracePosition readAx = AddStep(trace, { Reg(c_ax) }, { Reg(c_rdx) });
+    AddStep(trace, { Reg(c_rcx), Reg(c_rdx) }, {});
+
+    TimeTrackOptions options;
+    options.useWriterIndex = useWriterIndex;
+
+    // al is last written by the mov al at writeAl; the later ah write is skipped.
+    TraceRecordStore records = Track(trace, Reg(c_rcx), options);
+    int alRead = OnlyChild(records, 1);
+    CHECK(alRead != 0 && records.GetPosition(alRead) == readAl);
+    int alWriter = OnlyChild(records, alRead);
+    CHECK(alWriter != 0 && records.GetPosition(alWriter) == writeAl);
+    CHECK(alWriter != 0 && Children(records, alWriter).empty()); // rbx is never written
+
+    // ax covers both bytes, so its last writer is the ah write.
+    records = Track(trace, Reg(c_rdx), options);
+    int axRead = OnlyChild(records, 1);
+    CHECK(axRead != 0 && records.GetPosition(axRead) == readAx);
+    int axWriter = OnlyChild(records, axRead);
+    CHECK(axWriter != 0 && records.GetPosition(axWriter) == writeAh);
+
+    // ah is read after a write of al; its writer is the older eax.
+    SyntheticTrace ahTrace;
+    AddSubRegisters(ahTrace);
+    TracePosition ahDefined = AddStep(ahTrace, { Reg(c_rcx) }, { Reg(c_eax) });
+    AddStep(ahTrace, { Reg(c_rbx) }, { Reg(c_al) });
+    AddStep(ahTrace, { Reg(c_ah) }, {});
+
+    records = Track(ahTrace, Reg(c_ah), options);
+    int ahWriter = OnlyChild(records, 1);
+    CHECK(ahWriter != 0 && records.GetPosition(ahWriter) == ahDefined);
+}
+
+// With -bytes a write that covers part of a memory operand keeps only those bytes; the rest
+// becomes a sibling that is searched on its own and finds the older write.
+void TestGapSplitting(bool splitMemory)
+{
+    SyntheticTrace trace;
+    TracePosition writeWhole = AddStep(trace, { Reg(c_rbx) }, { Mem(c_heapBase) });
+    TracePosition writeHigh = AddStep(trace, { Reg(c_rcx) }, { Mem(c_heapBase + 4, 4) });
+    AddStep(trace, { Reg(c_rdx) }, { Mem(c_heapBase + 0x100) });
+    TracePosition load = AddStep(trace, { Mem(c_heapBase) }, { Reg(c_rax) });
+    AddStep(trace, { Reg(c_rax) }, {});
+
+    TimeTrackOptions options;
+    options.splitMemory = splitMemory;
+    TraceRecordStore records = Track(trace, Reg(c_rax), options);
+
+    std::vector<int> reads = Children(records, 1);
+
+    if (!splitMemory) {
+        // The whole qword resolves to the newest write of any of its bytes.
+        CHECK(reads.size() == 1);
+        if (reads.size() != 1) return;
+        CHECK(records.Get(reads[0]).byteCount == 0);
+        int writer = OnlyChild(records, reads[0]);
+        CHECK(writer != 0 && records.GetPosition(writer) == writeHigh);
+        return;
+    }
+
+    CHECK(reads.size() == 2);
+    if (reads.size() != 2) return;
+
+    for (int read : reads) {
+        TraceRecord record = records.Get(read);
+        CHECK(record.pos == load);
+        CHECK(record.parentId == 1);
+        CHECK(record.byteCount == 4);
+
+        int writer = OnlyChild(records, read);
+        CHECK(writer != 0);
+        if (writer == 0) continue;
+
+        if (record.byteOffset == 4) {
+            CHECK(records.GetPosition(writer) == writeHigh);
+        }
+        else {
+            CHECK(record.byteOffset == 0);
+            CHECK(records.GetPosition(writer) == writeWhole);
+        }
+    }
+}
+
+struct Test {
+    const char* name;
+    std::function<void()> run;
+};
+
+} // namespace
+
+int main()
+{
+    const Test tests[] = {
+        { "back-reference", [] { TestBackReference(1, TraceRecordStore::c_defaultSpillThreshold); } },
+        { "back-reference, 4 workers", [] { TestBackReference(4, TraceRecordStore::c_defaultSpillThreshold); } },
+        { "back-reference, spilled records", [] { TestBackReference(1, 2); } },
+        { "sub-registers", [] { TestSubRegisters(false); } },
+        { "sub-registers, index", [] { TestSubRegisters(true); } },
+        { "memory without -bytes", [] { TestGapSplitting(false); } },
+        { "gap splitting", [] { TestGapSplitting(true); } },
+    };
+
+    for (const Test& test : tests) {
+        int failures = g_failures;
+        test.run();
+        printf("%s %s\n", g_failures == failures ? "PASS" : "FAIL", test.name);
+    }
+
+    return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+#include "TrackTimeline.h"
+
+#include <cstdio>
+#include <fstream>
+
+TrackTimeline::TrackTimeline(size_t workerCount)
+    : m_start(std::chrono::steady_clock::now()), m_events(workerCount)
+{
+}
+
+size_t TrackTimeline::GetEventCount() const
+{
+    size_t count = 0;
+    for (const auto& events : m_events) {
+        count += events.size();
+    }
+    return count;
+}
+
+static const char* GetAnswerName(TimelineAnswer answer)
+{
+    switch (answer) {
+        case TimelineAnswer::Cache: return "cache";
+        case TimelineAnswer::Index: return "index";
+        case TimelineAnswer::Replay: return "replay";
+        default: return "none";
+    }
+}
+
+// Same text as the Position formatter, so it can be pasted into !tt.
+static std::string FormatPosition(TracePosition pos)
+{
+    if (!pos.IsValid()) return "none";
+
+    char text[40];
+    snprintf(text, sizeof(text), "%llX:%llX", (unsigned long long)pos.sequence, (unsigned long long)pos.steps);
+    return text;
+}
+
+// {"traceEvents":[...]} with a thread_name event per worker and a complete ("X") event per item.
+// Timestamps are microseconds since the timeline was created.
+bool TrackTimeline::Write(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"!timetrack\"}}";
+
+    for (size_t worker = 0; worker < m_events.size(); worker++) {
+        file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << worker
+             << ",\"args\":{\"name\":\"worker " << worker << "\"}}";
+    }
+
+    for (size_t worker = 0; worker < m_events.size(); worker++) {
+        for (const TimelineEvent& event : m_events[worker]) {
+            double ts = std::chrono::duration<double, std::micro>(event.start - m_start).count();
+            double dur = std::chrono::duration<double, std::micro>(event.end - event.start).count();
+
+            char name[64];
+            if (event.itemCount > 1) snprintf(name, sizeof(name), "memory x%zu #%d", event.itemCount, event.itemId);
+            else snprintf(name, sizeof(name), "%s #%d", event.memory ? "memory" : "register", event.itemId);
+
+            char timing[96];
+            snprintf(timing, sizeof(timing), "\"ts\":%.3f,\"dur\":%.3f", ts, dur);
+
+            file << ",\n{\"name\":\"" << name << "\",\"cat\":\"" << GetAnswerName(event.answer) << "\",\"ph\":\"X\","
+                 << timing << ",\"pid\":1,\"tid\":" << worker << ","
+                 << "\"args\":{\"item\":" << event.itemId << ",\"items\":" << event.itemCount
+                 << ",\"from\":\"" << FormatPosition(event.windowStart) << "\",\"to\":\"" << FormatPosition(event.windowEnd) << "\"}}";
+        }
+    }
+
+    file << "\n]}\n";
+    return (bool)file;
+}
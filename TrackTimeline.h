@@ -0,0 +1,54 @@
+// TrackTimeline.h
+//
+// Per-work-item timeline of one _TimeTrack run (-timeline:file), written as Chrome trace-event
+// JSON for chrome://tracing or Perfetto. Every worker is a thread of the trace and every work item
+// or memory batch it processed a complete event, so idle gaps show queue starvation and long bars
+// the searches that replayed far. Each worker appends to its own list; nothing is locked.
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "TraceSource.h"
+
+// How the write that defines a work item was found.
+enum class TimelineAnswer : uint8_t {
+    None,   // not resolved, e.g. the run stopped
+    Cache,  // write search cache
+    Index,  // last-writer index
+    Replay, // backward replay
+};
+
+struct TimelineEvent {
+    int itemId = 0;
+    size_t itemCount = 1;   // > 1 for a memory batch, itemId is its first item
+    bool memory = false;
+    TimelineAnswer answer = TimelineAnswer::None;
+
+    // The search went backward from windowStart to windowEnd: the write it found, or where the
+    // replay stopped. Invalid when there was no write.
+    TracePosition windowStart;
+    TracePosition windowEnd;
+
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+};
+
+class TrackTimeline {
+public:
+    explicit TrackTimeline(size_t workerCount);
+
+    // Only ever called by worker 'worker'.
+    void Add(size_t worker, const TimelineEvent& event) { m_events[worker].push_back(event); }
+
+    size_t GetEventCount() const;
+
+    // Call once the workers have finished.
+    bool Write(const std::string& path) const;
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+    std::vector<std::vector<TimelineEvent>> m_events;
+};
@@ -0,0 +1,51 @@
+// WorkStealingQueue.h
+//
+// Per-worker deque used by the _TimeTrack scheduler. The owning worker takes items from the
+// front, so a single worker keeps the breadth-first order; idle workers steal from the back.
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+template <typename T>
+class WorkStealingQueue {
+public:
+    void Push(const T& item) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_items.push_back(item);
+    }
+
+    std::optional<T> Pop() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_items.empty()) return std::nullopt;
+        T item = m_items.front();
+        m_items.pop_front();
+        return item;
+    }
+
+    // Takes items from the front while 'predicate' accepts them, at most 'maxCount'.
+    template <typename Predicate>
+    std::vector<T> PopWhile(Predicate predicate, size_t maxCount) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<T> items;
+        while (items.size() < maxCount && !m_items.empty() && predicate(m_items.front())) {
+            items.push_back(m_items.front());
+            m_items.pop_front();
+        }
+        return items;
+    }
+
+    std::optional<T> Steal() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_items.empty()) return std::nullopt;
+        T item = m_items.back();
+        m_items.pop_back();
+        return item;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::deque<T> m_items;
+};
@@ -0,0 +1,164 @@
+#include "WriterCacheFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <tuple>
+
+#include <Zydis/Zydis.h>
+
+static auto SortKey(WriterCacheFile::Entry const& entry)
+{
+    return std::tie(entry.location, entry.size, entry.thread, entry.querySequence, entry.querySteps);
+}
+
+bool WriterCacheFile::GetIdentity(const std::wstring& tracePath, IReplayEngineView* engine, Identity& identity)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExW(tracePath.c_str(), GetFileExInfoStandard, &attributes)) {
+        return false;
+    }
+
+    PositionRange lifetime = engine->GetLifetime();
+
+    identity.traceSize = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+    identity.traceWriteTime = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+    identity.lifetimeStart[0] = (uint64_t)lifetime.Min.Sequence;
+    identity.lifetimeStart[1] = (uint64_t)lifetime.Min.Steps;
+    identity.lifetimeEnd[0] = (uint64_t)lifetime.Max.Sequence;
+    identity.lifetimeEnd[1] = (uint64_t)lifetime.Max.Steps;
+    return true;
+}
+
+bool WriterCacheFile::Open(const std::wstring& path, Identity const& identity)
+{
+    Close();
+
+    m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_file, &fileSize) || (uint64_t)fileSize.QuadPart < sizeof(Header)) {
+        Close();
+        return false;
+    }
+
+    m_mapping = CreateFileMappingW(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_mapping) {
+        m_view = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (!m_view) {
+        Close();
+        return false;
+    }
+
+    const Header* header = (const Header*)m_view;
+    bool valid = memcmp(header->magic, c_magic, sizeof(c_magic)) == 0
+        && header->version == c_version
+        && header->entrySize == sizeof(Entry)
+        && header->registerCount == ZYDIS_REGISTER_MAX_VALUE
+        && header->identity == identity
+        && header->entryCount <= ((uint64_t)fileSize.QuadPart - sizeof(Header)) / sizeof(Entry);
+    if (!valid) {
+        Close();
+        return false;
+    }
+
+    m_path = path;
+    m_entries = (const Entry*)((const uint8_t*)m_view + sizeof(Header));
+    m_count = (size_t)header->entryCount;
+    return true;
+}
+
+void WriterCacheFile::Close()
+{
+    if (m_view) UnmapViewOfFile(m_view);
+    if (m_mapping) CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+
+    m_view = nullptr;
+    m_mapping = nullptr;
+    m_file = INVALID_HANDLE_VALUE;
+    m_entries = nullptr;
+    m_count = 0;
+    m_path.clear();
+}
+
+// Entries of one location do not overlap, so the first entry whose query is at or after 'pos' is
+// the only one that can answer it: an older writer in a later entry would have been found by this one.
+bool WriterCacheFile::Find(uint64_t location, uint64_t size, uint64_t thread, TracePosition pos, TracePosition& writer) const
+{
+    if (!m_entries) return false;
+
+    Entry probe = { location, size, thread, pos.sequence, pos.steps, 0, 0 };
+    const Entry* it = std::lower_bound(m_entries, m_entries + m_count, probe, [](Entry const& a, Entry const& b) {
+        return SortKey(a) < SortKey(b);
+    });
+
+    if (it == m_entries + m_count || it->location != location || it->size != size || it->thread != thread) {
+        return false;
+    }
+
+    if (it->writerSequence == c_noWriter) {
+        writer = TracePosition();
+        return true;
+    }
+
+    TracePosition found = { it->writerSequence, it->writerSteps };
+    if (!(found < pos)) {
+        return false;
+    }
+
+    writer = found;
+    return true;
+}
+
+bool WriterCacheFile::Write(const std::wstring& path, Identity const& identity, std::vector<Entry> entries)
+{
+    std::sort(entries.begin(), entries.end(), [](Entry const& a, Entry const& b) { return SortKey(a) < SortKey(b); });
+
+    // An entry followed by one with the same location and writer is covered by it: its query is later.
+    size_t kept = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry& entry = entries[i];
+        if (i + 1 < entries.size()) {
+            const Entry& next = entries[i + 1];
+            if (next.location == entry.location && next.size == entry.size && next.thread == entry.thread &&
+                next.writerSequence == entry.writerSequence && next.writerSteps == entry.writerSteps) {
+                continue;
+            }
+        }
+        entries[kept++] = entry;
+    }
+    entries.resize(kept);
+
+    Header header = {};
+    memcpy(header.magic, c_magic, sizeof(c_magic));
+    header.version = c_version;
+    header.entrySize = sizeof(Entry);
+    header.registerCount = ZYDIS_REGISTER_MAX_VALUE;
+    header.identity = identity;
+    header.entryCount = entries.size();
+
+    std::wstring tempPath = path + L".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)entries.data(), (std::streamsize)(entries.size() * sizeof(Entry)));
+        if (!file.flush()) {
+            file.close();
+            DeleteFileW(tempPath.c_str());
+            return false;
+        }
+    }
+
+    if (!MoveFileExW(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileW(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
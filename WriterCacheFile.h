@@ -0,0 +1,83 @@
+// WriterCacheFile.h
+//
+// On-disk copy of the LastWriterCache for one trace (-persist), stored next to the .run file as
+// <trace>.ttcache. The file is a header that identifies the trace followed by the cached search
+// results sorted by (location, size, thread, query position). It is mapped read-only and searched in
+// place, so a lookup is one binary search and opening it reads nothing but the header. A file
+// written for another trace, or by a build with other register numbering, is ignored and
+// replaced on the next save.
+#pragma once
+#include "stdafx.h"
+
+#include <Windows.h>
+#include <string>
+#include <vector>
+
+#include <TTD/IReplayEngine.h>
+
+#include "LastWriterCache.h"
+
+using namespace TTD;
+using namespace Replay;
+
+class WriterCacheFile : public IWriterCacheBacking {
+public:
+    using Entry = WriterCacheEntry;
+
+    // What the trace looked like when the file was written.
+    struct Identity {
+        uint64_t traceSize = 0;
+        uint64_t traceWriteTime = 0;
+        uint64_t lifetimeStart[2] = {};
+        uint64_t lifetimeEnd[2] = {};
+
+        bool operator==(Identity const&) const = default;
+    };
+
+    static constexpr uint64_t c_noWriter = WriterCacheEntry::c_noWriter;
+
+    WriterCacheFile() = default;
+    ~WriterCacheFile() { Close(); }
+    WriterCacheFile(const WriterCacheFile&) = delete;
+    WriterCacheFile& operator=(const WriterCacheFile&) = delete;
+
+    // Identity of the trace at 'tracePath' replayed by 'engine'. False when the file cannot be read.
+    static bool GetIdentity(const std::wstring& tracePath, IReplayEngineView* engine, Identity& identity);
+    static std::wstring GetCachePath(const std::wstring& tracePath) { return tracePath + L".ttcache"; }
+
+    // Maps 'path'. False when it does not exist or belongs to another trace; the object is empty then.
+    bool Open(const std::wstring& path, Identity const& identity);
+    void Close();
+
+    bool IsOpen() const { return m_view != nullptr; }
+    const std::wstring& GetPath() const { return m_path; }
+    size_t GetEntryCount() const { return m_count; }
+    const Entry* GetEntries() const { return m_entries; }
+
+    bool Find(uint64_t location, uint64_t size, uint64_t thread, TracePosition pos, TracePosition& writer) const override;
+
+    // Sorts 'entries', drops the ones a later entry covers and writes them to 'path'. The file
+    // must not be mapped by anyone; it is replaced atomically.
+    static bool Write(const std::wstring& path, Identity const& identity, std::vector<Entry> entries);
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t entrySize;
+        uint32_t registerCount;  // ZYDIS_REGISTER_MAX_VALUE: register keys depend on the numbering
+        uint32_t reserved;
+        Identity identity;
+        uint64_t entryCount;
+    };
+
+    static constexpr char c_magic[8] = { 'T', 'T', 'W', 'R', 'I', 'T', 'E', 'R' };
+    static constexpr uint32_t c_version = 2; // 2: memory results keyed by the searched thread
+
+    std::wstring m_path;
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+    const void* m_view = nullptr;
+    const Entry* m_entries = nullptr;
+    size_t m_count = 0;
+};
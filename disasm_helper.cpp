@@ -4,12 +4,145 @@
 #include <stdexcept>
 #include <unordered_map>
 #include <algorithm>
+#include <array>
 #include <cstring>
+#include <string_view>
+#include <utility>
 #include "disasm_helper.h"
+#include "PerfectNameHash.h"
 #include "RegisterNameMapping.h"
+#include "TrackStats.h"
 
 extern ProcessorArchitecture g_TargetCPUType;
 
+// Zydis names of the registers the context tables in RegisterNameMapping.h know about.
+// ZydisRegisterGetString is not constexpr, so the names are spelled out here.
+static constexpr std::pair<ZydisRegister, std::wstring_view> c_zydisRegisterNames[] = {
+    { ZYDIS_REGISTER_AL, L"al" }, { ZYDIS_REGISTER_CL, L"cl" }, { ZYDIS_REGISTER_DL, L"dl" }, { ZYDIS_REGISTER_BL, L"bl" },
+    { ZYDIS_REGISTER_AH, L"ah" }, { ZYDIS_REGISTER_CH, L"ch" }, { ZYDIS_REGISTER_DH, L"dh" }, { ZYDIS_REGISTER_BH, L"bh" },
+    { ZYDIS_REGISTER_SPL, L"spl" }, { ZYDIS_REGISTER_BPL, L"bpl" }, { ZYDIS_REGISTER_SIL, L"sil" }, { ZYDIS_REGISTER_DIL, L"dil" },
+    { ZYDIS_REGISTER_R8B, L"r8b" }, { ZYDIS_REGISTER_R9B, L"r9b" }, { ZYDIS_REGISTER_R10B, L"r10b" }, { ZYDIS_REGISTER_R11B, L"r11b" },
+    { ZYDIS_REGISTER_R12B, L"r12b" }, { ZYDIS_REGISTER_R13B, L"r13b" }, { ZYDIS_REGISTER_R14B, L"r14b" }, { ZYDIS_REGISTER_R15B, L"r15b" },
+    { ZYDIS_REGISTER_AX, L"ax" }, { ZYDIS_REGISTER_CX, L"cx" }, { ZYDIS_REGISTER_DX, L"dx" }, { ZYDIS_REGISTER_BX, L"bx" },
+    { ZYDIS_REGISTER_SP, L"sp" }, { ZYDIS_REGISTER_BP, L"bp" }, { ZYDIS_REGISTER_SI, L"si" }, { ZYDIS_REGISTER_DI, L"di" },
+    { ZYDIS_REGISTER_R8W, L"r8w" }, { ZYDIS_REGISTER_R9W, L"r9w" }, { ZYDIS_REGISTER_R10W, L"r10w" }, { ZYDIS_REGISTER_R11W, L"r11w" },
+    { ZYDIS_REGISTER_R12W, L"r12w" }, { ZYDIS_REGISTER_R13W, L"r13w" }, { ZYDIS_REGISTER_R14W, L"r14w" }, { ZYDIS_REGISTER_R15W, L"r15w" },
+    { ZYDIS_REGISTER_EAX, L"eax" }, { ZYDIS_REGISTER_ECX, L"ecx" }, { ZYDIS_REGISTER_EDX, L"edx" }, { ZYDIS_REGISTER_EBX, L"ebx" },
+    { ZYDIS_REGISTER_ESP, L"esp" }, { ZYDIS_REGISTER_EBP, L"ebp" }, { ZYDIS_REGISTER_ESI, L"esi" }, { ZYDIS_REGISTER_EDI, L"edi" },
+    { ZYDIS_REGISTER_R8D, L"r8d" }, { ZYDIS_REGISTER_R9D, L"r9d" }, { ZYDIS_REGISTER_R10D, L"r10d" }, { ZYDIS_REGISTER_R11D, L"r11d" },
+    { ZYDIS_REGISTER_R12D, L"r12d" }, { ZYDIS_REGISTER_R13D, L"r13d" }, { ZYDIS_REGISTER_R14D, L"r14d" }, { ZYDIS_REGISTER_R15D, L"r15d" },
+    { ZYDIS_REGISTER_RAX, L"rax" }, { ZYDIS_REGISTER_RCX, L"rcx" }, { ZYDIS_REGISTER_RDX, L"rdx" }, { ZYDIS_REGISTER_RBX, L"rbx" },
+    { ZYDIS_REGISTER_RSP, L"rsp" }, { ZYDIS_REGISTER_RBP, L"rbp" }, { ZYDIS_REGISTER_RSI, L"rsi" }, { ZYDIS_REGISTER_RDI, L"rdi" },
+    { ZYDIS_REGISTER_R8, L"r8" }, { ZYDIS_REGISTER_R9, L"r9" }, { ZYDIS_REGISTER_R10, L"r10" }, { ZYDIS_REGISTER_R11, L"r11" },
+    { ZYDIS_REGISTER_R12, L"r12" }, { ZYDIS_REGISTER_R13, L"r13" }, { ZYDIS_REGISTER_R14, L"r14" }, { ZYDIS_REGISTER_R15, L"r15" },
+    { ZYDIS_REGISTER_EFLAGS, L"eflags" }, { ZYDIS_REGISTER_EIP, L"eip" }, { ZYDIS_REGISTER_RIP, L"rip" }, { ZYDIS_REGISTER_MXCSR, L"mxcsr" },
+    { ZYDIS_REGISTER_CS, L"cs" }, { ZYDIS_REGISTER_DS, L"ds" }, { ZYDIS_REGISTER_ES, L"es" },
+    { ZYDIS_REGISTER_FS, L"fs" }, { ZYDIS_REGISTER_GS, L"gs" }, { ZYDIS_REGISTER_SS, L"ss" },
+    { ZYDIS_REGISTER_XMM0, L"xmm0" }, { ZYDIS_REGISTER_XMM1, L"xmm1" }, { ZYDIS_REGISTER_XMM2, L"xmm2" }, { ZYDIS_REGISTER_XMM3, L"xmm3" },
+    { ZYDIS_REGISTER_XMM4, L"xmm4" }, { ZYDIS_REGISTER_XMM5, L"xmm5" }, { ZYDIS_REGISTER_XMM6, L"xmm6" }, { ZYDIS_REGISTER_XMM7, L"xmm7" },
+    { ZYDIS_REGISTER_XMM8, L"xmm8" }, { ZYDIS_REGISTER_XMM9, L"xmm9" }, { ZYDIS_REGISTER_XMM10, L"xmm10" }, { ZYDIS_REGISTER_XMM11, L"xmm11" },
+    { ZYDIS_REGISTER_XMM12, L"xmm12" }, { ZYDIS_REGISTER_XMM13, L"xmm13" }, { ZYDIS_REGISTER_XMM14, L"xmm14" }, { ZYDIS_REGISTER_XMM15, L"xmm15" },
+};
+
+using RegisterContextTable = std::array<ContextPosition, ZYDIS_REGISTER_MAX_VALUE + 1>;
+
+// Indexed by ZydisRegister; Size == 0 for registers the architecture has no context slot for.
+static consteval RegisterContextTable MakeRegisterContextTable(ProcessorArchitecture architecture) {
+    RegisterContextTable table{};
+    for (auto const& [reg, name] : c_zydisRegisterNames) {
+        auto it = GetRegisterContextPosition(architecture, name);
+        if (it != GetRegisterNameToContextMap(architecture).end()) {
+            table[reg] = it->second;
+        }
+    }
+    return table;
+}
+
+static constexpr RegisterContextTable c_x86RegisterContextTable = MakeRegisterContextTable(ProcessorArchitecture::x86);
+static constexpr RegisterContextTable c_x64RegisterContextTable = MakeRegisterContextTable(ProcessorArchitecture::x64);
+
+static_assert(c_x64RegisterContextTable[ZYDIS_REGISTER_AH] == GetRegisterContextPosition(ProcessorArchitecture::x64, L"ah")->second);
+static_assert(c_x86RegisterContextTable[ZYDIS_REGISTER_BL] == GetRegisterContextPosition(ProcessorArchitecture::x86, L"bl")->second);
+static_assert(c_x86RegisterContextTable[ZYDIS_REGISTER_R8].Size == 0);
+static_assert(c_x64RegisterContextTable[ZYDIS_REGISTER_EFLAGS].Size == 4);
+static_assert(c_x64RegisterContextTable[ZYDIS_REGISTER_CS].Size == 2);
+
+static const ContextPosition* GetContextPosition(ProcessorArchitecture architecture, ZydisRegister reg) {
+    if ((size_t)reg >= c_x64RegisterContextTable.size()) return nullptr;
+
+    const ContextPosition* position = nullptr;
+    switch (architecture) {
+        case ProcessorArchitecture::x64: position = &c_x64RegisterContextTable[reg]; break;
+        case ProcessorArchitecture::x86: position = &c_x86RegisterContextTable[reg]; break;
+        default: return nullptr;
+    }
+    return position->Size != 0 ? position : nullptr;
+}
+
+// Names accepted by GetRegisterByName, lowercase. These are the ZydisRegisterGetString names of
+// the registers a track can start from, plus a few aliases. Registers without a context slot on
+// the target (st0, mm0, k0, xmm16, ...) are still recognized so that _TimeTrack can reject them.
+static constexpr std::pair<std::string_view, ZydisRegister> c_registerNames[] = {
+    { "al", ZYDIS_REGISTER_AL }, { "cl", ZYDIS_REGISTER_CL }, { "dl", ZYDIS_REGISTER_DL }, { "bl", ZYDIS_REGISTER_BL },
+    { "ah", ZYDIS_REGISTER_AH }, { "ch", ZYDIS_REGISTER_CH }, { "dh", ZYDIS_REGISTER_DH }, { "bh", ZYDIS_REGISTER_BH },
+    { "spl", ZYDIS_REGISTER_SPL }, { "bpl", ZYDIS_REGISTER_BPL }, { "sil", ZYDIS_REGISTER_SIL }, { "dil", ZYDIS_REGISTER_DIL },
+    { "r8b", ZYDIS_REGISTER_R8B }, { "r9b", ZYDIS_REGISTER_R9B }, { "r10b", ZYDIS_REGISTER_R10B }, { "r11b", ZYDIS_REGISTER_R11B },
+    { "r12b", ZYDIS_REGISTER_R12B }, { "r13b", ZYDIS_REGISTER_R13B }, { "r14b", ZYDIS_REGISTER_R14B }, { "r15b", ZYDIS_REGISTER_R15B },
+    { "ax", ZYDIS_REGISTER_AX }, { "cx", ZYDIS_REGISTER_CX }, { "dx", ZYDIS_REGISTER_DX }, { "bx", ZYDIS_REGISTER_BX },
+    { "sp", ZYDIS_REGISTER_SP }, { "bp", ZYDIS_REGISTER_BP }, { "si", ZYDIS_REGISTER_SI }, { "di", ZYDIS_REGISTER_DI },
+    { "r8w", ZYDIS_REGISTER_R8W }, { "r9w", ZYDIS_REGISTER_R9W }, { "r10w", ZYDIS_REGISTER_R10W }, { "r11w", ZYDIS_REGISTER_R11W },
+    { "r12w", ZYDIS_REGISTER_R12W }, { "r13w", ZYDIS_REGISTER_R13W }, { "r14w", ZYDIS_REGISTER_R14W }, { "r15w", ZYDIS_REGISTER_R15W },
+    { "eax", ZYDIS_REGISTER_EAX }, { "ecx", ZYDIS_REGISTER_ECX }, { "edx", ZYDIS_REGISTER_EDX }, { "ebx", ZYDIS_REGISTER_EBX },
+    { "esp", ZYDIS_REGISTER_ESP }, { "ebp", ZYDIS_REGISTER_EBP }, { "esi", ZYDIS_REGISTER_ESI }, { "edi", ZYDIS_REGISTER_EDI },
+    { "r8d", ZYDIS_REGISTER_R8D }, { "r9d", ZYDIS_REGISTER_R9D }, { "r10d", ZYDIS_REGISTER_R10D }, { "r11d", ZYDIS_REGISTER_R11D },
+    { "r12d", ZYDIS_REGISTER_R12D }, { "r13d", ZYDIS_REGISTER_R13D }, { "r14d", ZYDIS_REGISTER_R14D }, { "r15d", ZYDIS_REGISTER_R15D },
+    { "rax", ZYDIS_REGISTER_RAX }, { "rcx", ZYDIS_REGISTER_RCX }, { "rdx", ZYDIS_REGISTER_RDX }, { "rbx", ZYDIS_REGISTER_RBX },
+    { "rsp", ZYDIS_REGISTER_RSP }, { "rbp", ZYDIS_REGISTER_RBP }, { "rsi", ZYDIS_REGISTER_RSI }, { "rdi", ZYDIS_REGISTER_RDI },
+    { "r8", ZYDIS_REGISTER_R8 }, { "r9", ZYDIS_REGISTER_R9 }, { "r10", ZYDIS_REGISTER_R10 }, { "r11", ZYDIS_REGISTER_R11 },
+    { "r12", ZYDIS_REGISTER_R12 }, { "r13", ZYDIS_REGISTER_R13 }, { "r14", ZYDIS_REGISTER_R14 }, { "r15", ZYDIS_REGISTER_R15 },
+    { "st0", ZYDIS_REGISTER_ST0 }, { "st1", ZYDIS_REGISTER_ST1 }, { "st2", ZYDIS_REGISTER_ST2 }, { "st3", ZYDIS_REGISTER_ST3 },
+    { "st4", ZYDIS_REGISTER_ST4 }, { "st5", ZYDIS_REGISTER_ST5 }, { "st6", ZYDIS_REGISTER_ST6 }, { "st7", ZYDIS_REGISTER_ST7 },
+    { "mm0", ZYDIS_REGISTER_MM0 }, { "mm1", ZYDIS_REGISTER_MM1 }, { "mm2", ZYDIS_REGISTER_MM2 }, { "mm3", ZYDIS_REGISTER_MM3 },
+    { "mm4", ZYDIS_REGISTER_MM4 }, { "mm5", ZYDIS_REGISTER_MM5 }, { "mm6", ZYDIS_REGISTER_MM6 }, { "mm7", ZYDIS_REGISTER_MM7 },
+    { "xmm0", ZYDIS_REGISTER_XMM0 }, { "xmm1", ZYDIS_REGISTER_XMM1 }, { "xmm2", ZYDIS_REGISTER_XMM2 }, { "xmm3", ZYDIS_REGISTER_XMM3 },
+    { "xmm4", ZYDIS_REGISTER_XMM4 }, { "xmm5", ZYDIS_REGISTER_XMM5 }, { "xmm6", ZYDIS_REGISTER_XMM6 }, { "xmm7", ZYDIS_REGISTER_XMM7 },
+    { "xmm8", ZYDIS_REGISTER_XMM8 }, { "xmm9", ZYDIS_REGISTER_XMM9 }, { "xmm10", ZYDIS_REGISTER_XMM10 }, { "xmm11", ZYDIS_REGISTER_XMM11 },
+    { "xmm12", ZYDIS_REGISTER_XMM12 }, { "xmm13", ZYDIS_REGISTER_XMM13 }, { "xmm14", ZYDIS_REGISTER_XMM14 }, { "xmm15", ZYDIS_REGISTER_XMM15 },
+    { "xmm16", ZYDIS_REGISTER_XMM16 }, { "xmm17", ZYDIS_REGISTER_XMM17 }, { "xmm18", ZYDIS_REGISTER_XMM18 }, { "xmm19", ZYDIS_REGISTER_XMM19 },
+    { "xmm20", ZYDIS_REGISTER_XMM20 }, { "xmm21", ZYDIS_REGISTER_XMM21 }, { "xmm22", ZYDIS_REGISTER_XMM22 }, { "xmm23", ZYDIS_REGISTER_XMM23 },
+    { "xmm24", ZYDIS_REGISTER_XMM24 }, { "xmm25", ZYDIS_REGISTER_XMM25 }, { "xmm26", ZYDIS_REGISTER_XMM26 }, { "xmm27", ZYDIS_REGISTER_XMM27 },
+    { "xmm28", ZYDIS_REGISTER_XMM28 }, { "xmm29", ZYDIS_REGISTER_XMM29 }, { "xmm30", ZYDIS_REGISTER_XMM30 }, { "xmm31", ZYDIS_REGISTER_XMM31 },
+    { "ymm0", ZYDIS_REGISTER_YMM0 }, { "ymm1", ZYDIS_REGISTER_YMM1 }, { "ymm2", ZYDIS_REGISTER_YMM2 }, { "ymm3", ZYDIS_REGISTER_YMM3 },
+    { "ymm4", ZYDIS_REGISTER_YMM4 }, { "ymm5", ZYDIS_REGISTER_YMM5 }, { "ymm6", ZYDIS_REGISTER_YMM6 }, { "ymm7", ZYDIS_REGISTER_YMM7 },
+    { "ymm8", ZYDIS_REGISTER_YMM8 }, { "ymm9", ZYDIS_REGISTER_YMM9 }, { "ymm10", ZYDIS_REGISTER_YMM10 }, { "ymm11", ZYDIS_REGISTER_YMM11 },
+    { "ymm12", ZYDIS_REGISTER_YMM12 }, { "ymm13", ZYDIS_REGISTER_YMM13 }, { "ymm14", ZYDIS_REGISTER_YMM14 }, { "ymm15", ZYDIS_REGISTER_YMM15 },
+    { "ymm16", ZYDIS_REGISTER_YMM16 }, { "ymm17", ZYDIS_REGISTER_YMM17 }, { "ymm18", ZYDIS_REGISTER_YMM18 }, { "ymm19", ZYDIS_REGISTER_YMM19 },
+    { "ymm20", ZYDIS_REGISTER_YMM20 }, { "ymm21", ZYDIS_REGISTER_YMM21 }, { "ymm22", ZYDIS_REGISTER_YMM22 }, { "ymm23", ZYDIS_REGISTER_YMM23 },
+    { "ymm24", ZYDIS_REGISTER_YMM24 }, { "ymm25", ZYDIS_REGISTER_YMM25 }, { "ymm26", ZYDIS_REGISTER_YMM26 }, { "ymm27", ZYDIS_REGISTER_YMM27 },
+    { "ymm28", ZYDIS_REGISTER_YMM28 }, { "ymm29", ZYDIS_REGISTER_YMM29 }, { "ymm30", ZYDIS_REGISTER_YMM30 }, { "ymm31", ZYDIS_REGISTER_YMM31 },
+    { "zmm0", ZYDIS_REGISTER_ZMM0 }, { "zmm1", ZYDIS_REGISTER_ZMM1 }, { "zmm2", ZYDIS_REGISTER_ZMM2 }, { "zmm3", ZYDIS_REGISTER_ZMM3 },
+    { "zmm4", ZYDIS_REGISTER_ZMM4 }, { "zmm5", ZYDIS_REGISTER_ZMM5 }, { "zmm6", ZYDIS_REGISTER_ZMM6 }, { "zmm7", ZYDIS_REGISTER_ZMM7 },
+    { "zmm8", ZYDIS_REGISTER_ZMM8 }, { "zmm9", ZYDIS_REGISTER_ZMM9 }, { "zmm10", ZYDIS_REGISTER_ZMM10 }, { "zmm11", ZYDIS_REGISTER_ZMM11 },
+    { "zmm12", ZYDIS_REGISTER_ZMM12 }, { "zmm13", ZYDIS_REGISTER_ZMM13 }, { "zmm14", ZYDIS_REGISTER_ZMM14 }, { "zmm15", ZYDIS_REGISTER_ZMM15 },
+    { "zmm16", ZYDIS_REGISTER_ZMM16 }, { "zmm17", ZYDIS_REGISTER_ZMM17 }, { "zmm18", ZYDIS_REGISTER_ZMM18 }, { "zmm19", ZYDIS_REGISTER_ZMM19 },
+    { "zmm20", ZYDIS_REGISTER_ZMM20 }, { "zmm21", ZYDIS_REGISTER_ZMM21 }, { "zmm22", ZYDIS_REGISTER_ZMM22 }, { "zmm23", ZYDIS_REGISTER_ZMM23 },
+    { "zmm24", ZYDIS_REGISTER_ZMM24 }, { "zmm25", ZYDIS_REGISTER_ZMM25 }, { "zmm26", ZYDIS_REGISTER_ZMM26 }, { "zmm27", ZYDIS_REGISTER_ZMM27 },
+    { "zmm28", ZYDIS_REGISTER_ZMM28 }, { "zmm29", ZYDIS_REGISTER_ZMM29 }, { "zmm30", ZYDIS_REGISTER_ZMM30 }, { "zmm31", ZYDIS_REGISTER_ZMM31 },
+    { "k0", ZYDIS_REGISTER_K0 }, { "k1", ZYDIS_REGISTER_K1 }, { "k2", ZYDIS_REGISTER_K2 }, { "k3", ZYDIS_REGISTER_K3 },
+    { "k4", ZYDIS_REGISTER_K4 }, { "k5", ZYDIS_REGISTER_K5 }, { "k6", ZYDIS_REGISTER_K6 }, { "k7", ZYDIS_REGISTER_K7 },
+    { "flags", ZYDIS_REGISTER_FLAGS }, { "eflags", ZYDIS_REGISTER_EFLAGS }, { "rflags", ZYDIS_REGISTER_EFLAGS }, { "ip", ZYDIS_REGISTER_IP },
+    { "eip", ZYDIS_REGISTER_EIP }, { "rip", ZYDIS_REGISTER_RIP }, { "es", ZYDIS_REGISTER_ES }, { "cs", ZYDIS_REGISTER_CS },
+    { "ss", ZYDIS_REGISTER_SS }, { "ds", ZYDIS_REGISTER_DS }, { "fs", ZYDIS_REGISTER_FS }, { "gs", ZYDIS_REGISTER_GS },
+    { "mxcsr", ZYDIS_REGISTER_MXCSR },
+
+    // WinDbg and CONTEXT spellings. The context only holds eflags, so rflags is read as eflags.
+    { "efl", ZYDIS_REGISTER_EFLAGS }, { "segcs", ZYDIS_REGISTER_CS }, { "segds", ZYDIS_REGISTER_DS }, { "seges", ZYDIS_REGISTER_ES },
+    { "segfs", ZYDIS_REGISTER_FS }, { "seggs", ZYDIS_REGISTER_GS }, { "segss", ZYDIS_REGISTER_SS },
+};
+
+// Perfect hash over c_registerNames, built at compile time.
+static constexpr PerfectNameHash<std::size(c_registerNames), 128, 512> c_registerNameTable(c_registerNames);
+
 int GetCPUBusSize() {
 	if (g_TargetCPUType == ProcessorArchitecture::x64) {
         return 8;
@@ -74,54 +207,214 @@ GlobalContext GetGlobalContext(const IThreadView* thread) {
 #endif
 }
 
-ZydisRegister GetRegisterByName(const char* reg) {
-    static std::unordered_map<std::string, ZydisRegister> registerMap;
-    static bool isInitialized = false;
+// The value of 'reg' taken from the getter for its enclosing register, false when there is no getter for it.
+template <typename View>
+static bool TryReadNarrowRegister(const View* view, ZydisRegister reg, RegValue& value) {
+    ZydisMachineMode mode = g_TargetCPUType == ProcessorArchitecture::x64 ? ZYDIS_MACHINE_MODE_LONG_64 : ZYDIS_MACHINE_MODE_LEGACY_32;
+    ZydisRegister enclosingReg = ZydisRegisterGetLargestEnclosing(mode, reg);
 
-    int128_t df = 32 - 3;
+    uint64_t full = 0;
+    switch (enclosingReg) {
+        case ZYDIS_REGISTER_RIP: case ZYDIS_REGISTER_EIP: full = (uint64_t)view->GetProgramCounter(); break;
+        case ZYDIS_REGISTER_RSP: case ZYDIS_REGISTER_ESP: full = (uint64_t)view->GetStackPointer(); break;
+        case ZYDIS_REGISTER_RBP: case ZYDIS_REGISTER_EBP: full = (uint64_t)view->GetFramePointer(); break;
+        case ZYDIS_REGISTER_RAX: case ZYDIS_REGISTER_EAX: full = (uint64_t)view->GetBasicReturnValue(); break;
+        default: return false;
+    }
 
-    if (!isInitialized) {
-        for (int i = 0; i < ZYDIS_REGISTER_MAX_VALUE; ++i) {
-            ZydisRegister currentReg = (ZydisRegister)i;
-            const char* regStr = ZydisRegisterGetString(currentReg);
+    const ContextPosition* position = GetContextPosition(g_TargetCPUType, reg);
+    const ContextPosition* enclosingPosition = GetContextPosition(g_TargetCPUType, enclosingReg);
+    if (!position || !enclosingPosition) return false;
 
-            if (regStr) {
-                registerMap[regStr] = currentReg;
-            }
-        }
-        isInitialized = true;
+    // Sub-registers are a byte range of the enclosing one (ah is byte 1 of rax).
+    uint64_t shift = (position->Offset - enclosingPosition->Offset) * 8;
+    if (position->Size < sizeof(uint64_t)) {
+        full = (full >> shift) & ((1ull << (position->Size * 8)) - 1);
     }
 
-    if (!reg) return ZYDIS_REGISTER_NONE;
+    value = full;
+    return true;
+}
 
-    std::string query = reg;
-    std::transform(query.begin(), query.end(), query.begin(),
-        [](unsigned char c) { return std::tolower(c); });
+template <typename View>
+RegValue RegisterReader::ReadFrom(const View* view, ZydisRegister reg, bool bError) {
+    RegValue value = 0;
+    if (TryReadNarrowRegister(view, reg, value)) {
+        return value;
+    }
 
-    auto it = registerMap.find(query);
-    if (it != registerMap.end()) {
-        return it->second;
+    Position pos = view->GetPosition();
+    UniqueThreadId thread = view->GetThreadInfo().UniqueId;
+    if (m_contextPos != pos || m_contextThread != thread) {
+        ScopedPhaseTimer timer(TrackPhase::Context);
+        m_context = GetGlobalContext(view);
+        m_contextPos = pos;
+        m_contextThread = thread;
+    }
+
+    return GetRegisterValue(m_context, reg, bError);
+}
+
+RegValue RegisterReader::Read(const IThreadView* thread, ZydisRegister reg, bool bError) {
+    return ReadFrom(thread, reg, bError);
+}
+
+RegValue RegisterReader::Read(const ICursor* cursor, ZydisRegister reg, bool bError) {
+    return ReadFrom(cursor, reg, bError);
+}
+
+ZydisRegister GetVectorLaneRegister(ZydisRegister reg) {
+    switch (ZydisRegisterGetClass(reg)) {
+        case ZYDIS_REGCLASS_XMM:
+        case ZYDIS_REGCLASS_YMM:
+        case ZYDIS_REGCLASS_ZMM:
+            return (ZydisRegister)(ZYDIS_REGISTER_XMM0 + ZydisRegisterGetId(reg));
+        default:
+            return reg;
+    }
+}
+
+ZydisRegister GetTrackedRegister(ZydisMachineMode mode, ZydisRegister reg) {
+    ZydisRegister laneReg = GetVectorLaneRegister(reg);
+    if (laneReg != reg) return laneReg;
+    return ZydisRegisterGetLargestEnclosing(mode, reg);
+}
+
+uint16_t GetRegisterBytes(ZydisMachineMode mode, ZydisRegister reg) {
+    if (GetVectorLaneRegister(reg) != reg || ZydisRegisterGetClass(reg) == ZYDIS_REGCLASS_XMM) {
+        return 0xffff;
     }
 
-    return ZYDIS_REGISTER_NONE;
+    switch (reg) {
+        case ZYDIS_REGISTER_AH:
+        case ZYDIS_REGISTER_CH:
+        case ZYDIS_REGISTER_DH:
+        case ZYDIS_REGISTER_BH:
+            return 0x0002;
+        default:
+            break;
+    }
+
+    uint32_t size = ZydisRegisterGetWidth(mode, reg) / 8;
+    if (size >= 16) return 0xffff;
+    return (uint16_t)((1u << size) - 1);
+}
+
+// Case-insensitive, no allocation, no lazily built state; safe from any thread.
+ZydisRegister GetRegisterByName(const char* reg) {
+    if (!reg) return ZYDIS_REGISTER_NONE;
+
+    int index = c_registerNameTable.Find(reg);
+    if (index < 0) return ZYDIS_REGISTER_NONE;
+    return c_registerNames[index].second;
+}
+
+bool HasContextSlot(ZydisRegister reg) {
+    return GetContextPosition(g_TargetCPUType, reg) != nullptr;
 }
 
 RegValue GetRegisterValue(const GlobalContext& context, ZydisRegister reg, bool bError) {
     RegValue ret = 0;
-    std::string temp(ZydisRegisterGetString(reg));
-    std::wstring wideName(temp.begin(), temp.end());
-
-    auto it = GetRegisterContextPosition(g_TargetCPUType, wideName);
 
-    if(it == GetRegisterNameToContextMap(g_TargetCPUType).end()) {
+    const ContextPosition* position = GetContextPosition(g_TargetCPUType, reg);
+    if (!position) {
         if (bError)
             throw std::runtime_error("Unsupported register.");
         return ret;
 	}
 
-    size_t offset = it->second.Offset;
-    size_t size = it->second.Size;
-
-    std::memcpy(&ret, (const uint8_t*)&context + offset, size);
+    std::memcpy(&ret, (const uint8_t*)&context + position->Offset, position->Size);
     return ret;
+}
+
+RegisterWriteSet GetWrittenRegisters(const ZydisDecodedInstruction& instruction, const ZydisDecodedOperand* operands) {
+    RegisterWriteSet set;
+
+    switch (instruction.mnemonic) {
+        case ZYDIS_MNEMONIC_SYSCALL:
+        case ZYDIS_MNEMONIC_SYSENTER:
+        case ZYDIS_MNEMONIC_INT:
+        case ZYDIS_MNEMONIC_INT1:
+        case ZYDIS_MNEMONIC_INT3:
+        case ZYDIS_MNEMONIC_INTO:
+        case ZYDIS_MNEMONIC_XRSTOR:
+        case ZYDIS_MNEMONIC_XRSTOR64:
+        case ZYDIS_MNEMONIC_XRSTORS:
+        case ZYDIS_MNEMONIC_XRSTORS64:
+        case ZYDIS_MNEMONIC_FXRSTOR:
+        case ZYDIS_MNEMONIC_FXRSTOR64:
+            set.opaque = true;
+            break;
+        default:
+            break;
+    }
+
+    for (int i = 0; i < instruction.operand_count; i++) {
+        const ZydisDecodedOperand& op = operands[i];
+        if (op.type != ZYDIS_OPERAND_TYPE_REGISTER || !(op.actions & ZYDIS_OPERAND_ACTION_MASK_WRITE)) {
+            continue;
+        }
+
+        // A write to ymmN or zmmN also writes xmmN; VEX/EVEX writes to xmmN clear the upper lanes.
+        ZydisRegister enclosingReg = GetTrackedRegister(instruction.machine_mode, op.reg.value);
+        if (enclosingReg == ZYDIS_REGISTER_NONE) {
+            continue;
+        }
+
+        // READ_CONDWRITE (cmovcc) carries the READ bit, so only the plain WRITE bit means unconditional.
+        bool isConditional = !(op.actions & ZYDIS_OPERAND_ACTION_WRITE);
+
+        // 32-bit general purpose writes zero the upper half of the 64-bit register.
+        uint16_t bytes = GetRegisterBytes(instruction.machine_mode, op.reg.value);
+        if (instruction.machine_mode == ZYDIS_MACHINE_MODE_LONG_64 &&
+            ZydisRegisterGetClass(op.reg.value) == ZYDIS_REGCLASS_GPR32) {
+            bytes = 0x00ff;
+        }
+
+        int index = set.IndexOf(enclosingReg);
+        if (index < 0) {
+            index = set.count++;
+            set.regs[index] = enclosingReg;
+            if (isConditional) set.conditional |= (uint16_t)(1u << index);
+        }
+        else if (!isConditional) {
+            set.conditional &= (uint16_t)~(1u << index);
+        }
+        if (!isConditional) set.bytes[index] |= bytes;
+    }
+
+    return set;
+}
+
+WrittenRegisterCache::WrittenRegisterCache(ProcessorArchitecture cpuType) {
+    SetupZydisDecoder(&m_decoder, cpuType);
+}
+
+const RegisterWriteSet& WrittenRegisterCache::Get(const IThreadView* thread) {
+    uint64_t pc = (uint64_t)thread->GetProgramCounter();
+
+    auto it = m_sets.find(pc);
+    if (it != m_sets.end()) {
+        return it->second;
+    }
+
+    uint8_t bytes[ZYDIS_MAX_INSTRUCTION_LENGTH];
+    BufferView bufferView{ bytes, sizeof(bytes) };
+    thread->QueryMemoryBuffer((GuestAddress)pc, bufferView);
+
+    ScopedPhaseTimer timer(TrackPhase::Decode);
+
+    ZydisDecodedInstruction instruction;
+    ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT];
+
+    RegisterWriteSet set;
+    if (ZYAN_SUCCESS(ZydisDecoderDecodeFull(&m_decoder, bytes, sizeof(bytes), &instruction, operands))) {
+        set = GetWrittenRegisters(instruction, operands);
+    }
+    else {
+        // Undecodable bytes: let the caller fall back to comparing values.
+        set.opaque = true;
+    }
+
+    return m_sets.emplace(pc, set).first->second;
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 
 #include <Zydis/Zydis.h>
 #include <__msvc_int128.hpp>
+#include <unordered_map>
 
 using namespace TTD;
 using namespace Replay;
@@ -33,3 +34,80 @@ GlobalContext GetGlobalContext(const IThreadView* thread);
 
 RegValue GetRegisterValue(const GlobalContext& context, ZydisRegister reg, bool bError=true);
 ZydisRegister GetRegisterByName(const char* reg);
+
+// True when the thread context of the target holds 'reg', i.e. its value can be read at any position.
+bool HasContextSlot(ZydisRegister reg);
+
+// xmm, ymm and zmm registers are tracked through their low 128-bit lane, xmmN, which is the part of a
+// vector register the thread context holds. Every other register is returned unchanged.
+ZydisRegister GetVectorLaneRegister(ZydisRegister reg);
+
+// The register a read or write of 'reg' is tracked as: the vector lane for SIMD registers,
+// the largest enclosing register otherwise.
+ZydisRegister GetTrackedRegister(ZydisMachineMode mode, ZydisRegister reg);
+
+// The bytes of GetTrackedRegister(mode, reg) that 'reg' occupies, bit i for byte i:
+// 0x0002 for ah, 0x000f for eax, 0xffff for xmm0 and every ymm/zmm register.
+uint16_t GetRegisterBytes(ZydisMachineMode mode, ZydisRegister reg);
+
+// Reads single registers without copying the whole context where it can. The instruction pointer,
+// stack pointer, frame pointer and return value register (and their sub-registers) come from the
+// narrow getters of the thread view; any other register reads the full context once per position
+// and keeps it for the next read at the same position. One instance per search, not thread-safe.
+class RegisterReader {
+public:
+    RegValue Read(const IThreadView* thread, ZydisRegister reg, bool bError = true);
+    RegValue Read(const ICursor* cursor, ZydisRegister reg, bool bError = true);
+
+private:
+    template <typename View>
+    RegValue ReadFrom(const View* view, ZydisRegister reg, bool bError);
+
+    GlobalContext m_context = {};
+    Position m_contextPos = Position::Invalid;
+    UniqueThreadId m_contextThread = {};
+};
+
+// Registers an instruction writes, reduced to their largest enclosing register.
+// 'opaque' is set for instructions whose register effects the decoder cannot list
+// (system calls, interrupts, state restores); callers have to compare values for those.
+// Registers that are only written when a condition holds (cmovcc, ...) are flagged in 'conditional'.
+struct RegisterWriteSet {
+    ZydisRegister regs[ZYDIS_MAX_OPERAND_COUNT] = {};
+    uint16_t bytes[ZYDIS_MAX_OPERAND_COUNT] = {};   // bytes of regs[i] written unconditionally, see GetRegisterBytes
+    uint16_t conditional = 0;   // bit i set: regs[i] may be left untouched
+    uint8_t count = 0;
+    bool opaque = false;
+
+    int IndexOf(ZydisRegister enclosingReg) const {
+        for (uint8_t i = 0; i < count; i++) {
+            if (regs[i] == enclosingReg) return i;
+        }
+        return -1;
+    }
+
+    bool Contains(ZydisRegister enclosingReg) const { return IndexOf(enclosingReg) >= 0; }
+
+    // True when every byte in 'byteMask' of the enclosing register is written unconditionally,
+    // so a write to ah does not count as a definition of al.
+    bool AlwaysWrites(ZydisRegister enclosingReg, uint16_t byteMask) const {
+        int i = IndexOf(enclosingReg);
+        return i >= 0 && (bytes[i] & byteMask) == byteMask;
+    }
+};
+
+RegisterWriteSet GetWrittenRegisters(const ZydisDecodedInstruction& instruction, const ZydisDecodedOperand* operands);
+
+// Decodes each program counter once and keeps its RegisterWriteSet, so replay callbacks that
+// run for every executed instruction only pay for a hash lookup on code they have seen before.
+class WrittenRegisterCache {
+public:
+    explicit WrittenRegisterCache(ProcessorArchitecture cpuType);
+
+    const RegisterWriteSet& Get(const IThreadView* thread);
+    ZydisMachineMode GetMachineMode() const { return m_decoder.machine_mode; }
+
+private:
+    ZydisDecoder m_decoder;
+    std::unordered_map<uint64_t, RegisterWriteSet> m_sets;
+};
@@ -4,6 +4,7 @@
 #include "stdafx.h"
 
 #include <Windows.h>
+#include <algorithm>
 #include <exception>
 #include <stdexcept>
 #include <vector>
@@ -12,9 +13,18 @@
 #include <iostream>
 #include <sstream>
 #include <deque>
-#include <fstream>
 #include <map>
 #include <set>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <chrono>
+#include <fstream>
 
 #include "Formatters.h"
 #include "ReplayHelpers.h"
@@ -27,6 +37,18 @@
 #include <atlcomcli.h>
 
 #include "disasm_helper.h"
+#include "LastWriterIndex.h"
+#include "LastWriterCache.h"
+#include "DecodeCache.h"
+#include "SymbolCache.h"
+#include "TrackStream.h"
+#include "TrackBudget.h"
+#include "StackClassifier.h"
+#include "TrackStats.h"
+#include "TrackTimeline.h"
+#include "WriterCacheFile.h"
+#include "ReplayTraceSource.h"
+#include "TrackEngine.h"
 
 #include <Zydis/Zydis.h>
 #include "TimeTrackGUI.h"
@@ -38,177 +60,151 @@ extern ProcessorArchitecture g_TargetCPUType;
 
 extern TimeTrackGUI::TimeTrackGUIWnd* track_gui;
 
-std::map<int, std::vector<TraceRecord>> g_LastTraceTree;
-
-// ----------------------------------------------------------------------------
-// Core Logic
-// ----------------------------------------------------------------------------
-
-// Find previous write to register
-// Returns Position::Invalid if not found.
-Position FindRegisterWrite(ICursor* cursor, ZydisRegister reg)
-{
-    struct __TargetReg {
-        ZydisRegister reg = ZYDIS_REGISTER_NONE;
-        RegValue value = 0;
-    };
-
-    __TargetReg targetReg;
-    targetReg.reg = reg;
-
-    GlobalContext context = GetGlobalContext(cursor);
-    try {
-        targetReg.value = GetRegisterValue(context, reg);
-    }
-    catch (...) {
-        return Position::Invalid;
-    }
-
-    auto _MemoryWatchpointCallback = [](uintptr_t targetPtr, ICursor::MemoryWatchpointResult const&, IThreadView const* thread) {
-        __TargetReg target = *(__TargetReg*)targetPtr;
-
-        RegValue val;
-
-        try
-        {
-            val = GetRegisterValue(GetGlobalContext(thread), target.reg);
-        }
-        catch (...)
-        {
-            return false;
-        }
-
-        if (val != target.value) {
-            return true;
-        }
-
-        return false;
-    };
-
-    MemoryWatchpointData wd = { GuestAddress::Min, (uint64_t)GuestAddress::Max, DataAccessMask::Execute };
-
-    cursor->AddMemoryWatchpoint(wd);
-    cursor->SetEventMask(EventMask::MemoryWatchpoint);
-    cursor->SetReplayFlags(ReplayFlags::ReplayOnlyCurrentThread | ReplayFlags::ReplaySegmentsSequentially);
-    cursor->SetMemoryWatchpointCallback(_MemoryWatchpointCallback, (uintptr_t)&targetReg);
-
-    ICursorView::ReplayResult result = cursor->ReplayBackward();
-
-    cursor->RemoveMemoryWatchpoint(wd);
+TraceRecordStore g_LastTraceTree;
 
-    if (result.StopReason == EventType::MemoryWatchpoint) {
-        return cursor->GetPosition();
-    }
-
-    return Position::Invalid;
-}
+// Write search results, kept for the whole debugging session.
+LastWriterCache g_WriterCache;
 
-// Find previous write to memory
-Position FindMemoryWrite(ICursor* cursor, uint64_t address, uint64_t size)
-{
-    MemoryWatchpointData wd = { (GuestAddress)address, size, DataAccessMask::Write };
+// Write search results of earlier sessions on the same trace (-persist).
+WriterCacheFile g_WriterCacheFile;
 
-    cursor->AddMemoryWatchpoint(wd);
-    cursor->SetEventMask(EventMask::MemoryWatchpoint);
-    cursor->SetReplayFlags(ReplayFlags::None);
+// Decoded instructions, shared by the workers and the printers.
+DecodeCache g_DecodeCache;
 
-    ICursorView::ReplayResult result = cursor->ReplayBackward();
-
-	cursor->RemoveMemoryWatchpoint(wd);
-
-    if (result.StopReason == EventType::MemoryWatchpoint){
-        Position pos = cursor->GetPosition() - 1;
-		cursor->SetPosition(pos);
-        return pos;
-    }
-
-    return Position::Invalid;
-}
+// Symbol names, shared by the printers.
+SymbolCache g_SymbolCache;
 
 // ----------------------------------------------------------------------------
 // Main Logic
 // ----------------------------------------------------------------------------
 
+std::set<int> CollectReferencedIds(const TraceRecordStore& records)
+{
+    std::set<int> referenced;
+    for (int id = 1; id <= records.GetMaxId(); id++) {
+        if (records.Contains(id) && records.GetRefId(id) != 0) referenced.insert(records.GetRefId(id));
+    }
+    return referenced;
+}
 
-void PrintRecordTreeIterative(IDebugClient* client, std::map<int, std::vector<TraceRecord>>& tree, int rootId = 0) {
+void PrintRecordTreeIterative(IDebugClient* client, const TraceRecordStore& tree, int rootId = 0) {
     CComQIPtr<IDebugControl> control(client);
     CComQIPtr<IDebugSymbols3> symbols(client);
 
 	if (!control || !symbols) return;
-    
-    ZydisDecoder decoder;
-    SetupZydisDecoder(&decoder, g_TargetCPUType);
-
-    ZydisFormatter formatter;
-    ZydisFormatterInit(&formatter, ZYDIS_FORMATTER_STYLE_INTEL);
-
-    char buffer[256];
-    BufferView bufferView{ buffer, sizeof(buffer) };
-    ZydisDecodedInstruction instruction;
-    ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT];
 
     UniqueCursor inspectCursor(g_pReplayEngine->NewCursor());
 
     struct StackState {
-        const TraceRecord* record;
+        int id;
         int depth;
     };
 
     std::deque<StackState> workStack;
 
-    auto rootIt = tree.find(rootId);
-    if (rootIt != tree.end()) {
-        const auto& children = rootIt->second;
-        for (auto it = children.rbegin(); it != children.rend(); ++it) {
-            workStack.push_back({ &(*it), 0 });
-        }
+    std::set<int> referenced = CollectReferencedIds(tree);
+
+    auto rootChildren = tree.GetChildren(rootId);
+    for (auto it = rootChildren.rbegin(); it != rootChildren.rend(); ++it) {
+        workStack.push_back({ (int)*it, 0 });
     }
 
     while (!workStack.empty()) {
         StackState current = workStack.back();
         workStack.pop_back();
 
-        const TraceRecord& record = *current.record;
+        TraceRecord record = tree.Get(current.id);
         int depth = current.depth;
 
-        inspectCursor->SetPosition(record.pos);
+        inspectCursor->SetPosition(ReplayTraceSource::ToPosition(record.pos));
         
         uint64_t curIP = (uint64_t)inspectCursor->GetProgramCounter();
         
         std::string output;
         output.append(depth, '-');
 
+        if (record.refId != 0) {
+            output += std::format("=> #{}\t", record.refId);
+        }
+        else if (referenced.count(record.id)) {
+            output += std::format("#{}\t", record.id);
+        }
+
         output += std::format("<exec cmd=\"!tt {}\">{}</exec>\t", record.pos, record.pos);
 
-        uint64_t uDisp;
-		symbols->GetNameByOffset(curIP, buffer, sizeof(buffer), NULL, &uDisp);
-        output += std::format("{}+{:X}", buffer, uDisp);
+        SymbolName symbol = g_SymbolCache.Get(symbols, curIP);
+        output += std::format("{}+{:X}", symbol.name, symbol.displacement);
         output += "\t";
 
-        inspectCursor->QueryMemoryBuffer((GuestAddress)curIP, bufferView);
+        if (auto decoded = g_DecodeCache.Get(inspectCursor.get())) {
+            output += decoded->text;
+        }
+
+        if (record.byteCount != 0) {
+            output += std::format("\t(bytes {}-{})", record.byteOffset, record.byteOffset + record.byteCount - 1);
+        }
 
-        if (ZYAN_SUCCESS(ZydisDecoderDecodeFull(&decoder, buffer, 16, &instruction, operands))) {
-            ZydisFormatterFormatInstruction(&formatter, &instruction, operands, instruction.operand_count_visible, buffer, sizeof(buffer), curIP, ZYAN_NULL);
-            output += buffer;
+        if (record.flags & TraceRecordOutsideWindow) {
+            output += "\t(not found within window)";
         }
 
         output += "\n";
 
         control->ControlledOutput(DEBUG_OUTCTL_THIS_CLIENT | DEBUG_OUTCTL_DML, DEBUG_OUTPUT_NORMAL, output.c_str());
 
-        auto childIt = tree.find(record.id);
-        if (childIt != tree.end()) {
-            const auto& children = childIt->second;
-            for (auto it = children.rbegin(); it != children.rend(); ++it) {
-                workStack.push_back({ &(*it), depth + 1 });
-            }
+        auto children = tree.GetChildren(record.id);
+        for (auto it = children.rbegin(); it != children.rend(); ++it) {
+            workStack.push_back({ (int)*it, depth + 1 });
         }
     }
 }
 
-std::map<int, std::vector<TraceRecord>> _TimeTrack(IDebugClient* client, std::string targetStr, int size, int maxSteps)
+// -persist: the cache file next to the loaded trace and the identity it must carry.
+// False when dbgeng does not report the trace file.
+static bool GetWriterCacheFile(IDebugClient* client, std::wstring& path, WriterCacheFile::Identity& identity)
 {
-    std::map<int, std::vector<TraceRecord>> tree;
+    CComQIPtr<IDebugClient4> client4(client);
+    if (!client4) return false;
+
+    wchar_t tracePath[MAX_PATH] = {};
+    ULONG64 handle = 0;
+    ULONG type = 0;
+    if (FAILED(client4->GetDumpFileWide(0, tracePath, MAX_PATH, NULL, &handle, &type))) return false;
+    if (!WriterCacheFile::GetIdentity(tracePath, g_pReplayEngine, identity)) return false;
+
+    path = WriterCacheFile::GetCachePath(tracePath);
+    return true;
+}
+
+// Merges the session's search results into the cache file and maps the new file.
+static void SaveWriterCacheFile(const std::wstring& path, WriterCacheFile::Identity const& identity)
+{
+    const WriterCacheFile::Entry* saved = g_WriterCacheFile.GetEntries();
+    std::vector<WriterCacheFile::Entry> entries(saved, saved + g_WriterCacheFile.GetEntryCount());
+    size_t savedCount = entries.size();
+
+    g_WriterCache.Export(entries);
+    if (entries.size() == savedCount) return;
+
+    // The file cannot be replaced while it is mapped.
+    g_WriterCache.SetBackingFile(nullptr);
+    g_WriterCacheFile.Close();
+
+    if (!WriterCacheFile::Write(path, identity, std::move(entries))) {
+        dprintf("ERROR: Cannot write %ws\n", path.c_str());
+    }
+
+    if (g_WriterCacheFile.Open(path, identity)) {
+        g_WriterCache.SetBackingFile(&g_WriterCacheFile);
+    }
+}
+
+TraceRecordStore _TimeTrack(IDebugClient* client, std::string targetStr, int size, int maxSteps, const TimeTrackOptions& options)
+{
+    g_TrackStats.Reset();
+    ScopedPhaseTimer timer(TrackPhase::Track);
+
+    TraceRecordStore tree(options.spillThreshold);
     g_TargetCPUType = GetGuestArchitecture(*g_pGlobalCursor);
 
     if (g_TargetCPUType == ProcessorArchitecture::Invalid || g_TargetCPUType == ProcessorArchitecture::Arm64 || g_TargetCPUType == ProcessorArchitecture::ARM32) {
@@ -220,225 +216,220 @@ std::map<int, std::vector<TraceRecord>> _TimeTrack(IDebugClient* client, std::st
 
     if (!control) return tree;
 
-    char tempPath[MAX_PATH];
-    GetTempPathA(MAX_PATH, tempPath);
-
-    std::string tempFile = std::format("{}timetrack_{}.bin", tempPath, GetTickCount());
-
-    std::ofstream outFile(tempFile, std::ios::binary);
-    if (!outFile.is_open()) {
-        dprintf("Failed to create temporary file: %s\n", tempFile.c_str());
-        return tree;
-    }
-
+    // Worker 0 replays on inspectCursor, every additional worker gets a cursor of its own.
     UniqueCursor inspectCursor(g_pReplayEngine->NewCursor());
     inspectCursor->SetPosition(g_pGlobalCursor->GetPosition());
+    TracePosition startPos = ReplayTraceSource::FromPosition(inspectCursor->GetPosition());
+
+    StackClassifier stacks(g_TargetCPUType);
+    std::vector<UniqueCursor> extraCursors;
+    std::vector<std::unique_ptr<ReplayTraceSource>> sources;
+    sources.push_back(std::make_unique<ReplayTraceSource>(inspectCursor.get(), stacks));
+    for (unsigned int i = 1; i < options.workerCount; i++) {
+        extraCursors.emplace_back(g_pReplayEngine->NewCursor());
+        sources.push_back(std::make_unique<ReplayTraceSource>(extraCursors.back().get(), stacks));
+    }
 
-    ZydisDecoder decoder;
-    SetupZydisDecoder(&decoder, g_TargetCPUType);
-
-    struct WorkItem {
-        int parentId; // The ID of the TraceRecord that spawned this work item
-        int id;
-        ZydisOperandType type;
-        ZydisRegister reg;
-        uint64_t memAddr;
-        uint32_t memSize;
-        Position pos;
-    };
-
-    int idCounter = 0;
+    std::vector<ITraceSource*> workerSources;
+    for (auto& source : sources) workerSources.push_back(source.get());
+
+    LastWriterIndex writerIndex;
+    if (options.useWriterIndex) {
+        if (writerIndex.Build(*sources[0], startPos, options.indexWindowSteps)) {
+            dprintf("Indexed %zu register writes and %zu memory writes back to %s.\n",
+                writerIndex.GetRegisterWriteCount(), writerIndex.GetMemoryWriteCount(),
+                std::format("{}", writerIndex.GetWindowStart()).c_str());
+            if (writerIndex.IsFull()) {
+                dprintf("The index is full; older writes are searched by replay.\n");
+            }
+        }
+    }
 
-    WorkItem rootItem;
-    rootItem.parentId = 0;
-    rootItem.pos = inspectCursor->GetPosition();
+    g_WriterCache.BindTo(g_pReplayEngine);
+    g_DecodeCache.BindTo(g_pReplayEngine, g_TargetCPUType);
+    g_SymbolCache.BindTo(g_pReplayEngine);
 
-    TraceRecord rootRecord = {};
-    rootRecord.id = ++idCounter;
-    rootItem.id = idCounter;
+    TrackBudget budget(options);
+    TrackSession session(options, budget, writerIndex, g_WriterCache, tree, maxSteps);
 
-    rootRecord.parentId = 0;
-    rootRecord.pos = inspectCursor->GetPosition();
+    std::optional<TrackStream> stream;
+    if (options.streamOutput) {
+        stream.emplace(client);
+        session.output = &*stream;
+    }
 
-    ZydisRegister TargetRegister = GetRegisterByName(targetStr.c_str());
+    // ymm/zmm targets are followed through their low lane, like vector operands further down.
+    ZydisRegister TargetRegister = GetVectorLaneRegister(GetRegisterByName(targetStr.c_str()));
+    TraceLocation rootLocation;
 
     if (TargetRegister == ZYDIS_REGISTER_NONE) {
-        rootItem.type = ZYDIS_OPERAND_TYPE_MEMORY;
         DEBUG_VALUE val;
         if (SUCCEEDED(control->Evaluate(targetStr.c_str(), DEBUG_VALUE_INT64, &val, NULL))) {
-            rootItem.memAddr = val.I64;
-            rootItem.memSize = size;
-            if (rootItem.memSize == 0) rootItem.memSize = 8;
+            rootLocation = TraceLocation::Memory(val.I64, size == 0 ? 8 : size);
         }
         else {
             dprintf("Invalid argument.\n");
-            outFile.close();
-            DeleteFileA(tempFile.c_str());
             return tree;
         }
     }
+    else if (!HasContextSlot(TargetRegister)) {
+        dprintf("ERROR: %s is not part of the thread context and cannot be tracked.\n", targetStr.c_str());
+        return tree;
+    }
     else {
-        rootItem.type = ZYDIS_OPERAND_TYPE_REGISTER;
-        rootItem.reg = TargetRegister;
-        rootItem.memSize = _ZydisGetRegisterWidth(g_TargetCPUType, TargetRegister) / 8;
+        rootLocation = TraceLocation::Register(TargetRegister, _ZydisGetRegisterWidth(g_TargetCPUType, TargetRegister) / 8);
     }
 
-    outFile.write((char*)&rootRecord, sizeof(TraceRecord));
+    WorkItem rootItem = session.AddRoot(*sources[0], rootLocation, startPos);
 
-    std::deque<WorkItem> queue;
-    queue.push_back(rootItem);
+    // Reopened every run: the header is all it reads, and it may have been rewritten by another session.
+    g_WriterCache.SetBackingFile(nullptr);
+    g_WriterCacheFile.Close();
 
-    int steps = 0;
+    std::wstring cachePath;
+    WriterCacheFile::Identity cacheIdentity;
+    bool persist = options.persistCache && GetWriterCacheFile(client, cachePath, cacheIdentity);
+    if (persist) {
+        if (g_WriterCacheFile.Open(cachePath, cacheIdentity)) {
+            g_WriterCache.SetBackingFile(&g_WriterCacheFile);
+            dprintf("Using %zu saved search results from %ws\n", g_WriterCacheFile.GetEntryCount(), cachePath.c_str());
+        }
+    }
+    else if (options.persistCache) {
+        dprintf("The trace file is unknown, search results are not saved.\n");
+    }
 
-    while (!queue.empty() && steps < maxSteps) {
-        WorkItem item = queue.front();
-        queue.pop_front();
-        steps++;
+    std::optional<TrackTimeline> timeline;
+    if (!options.timelinePath.empty()) {
+        timeline.emplace(workerSources.size());
+        session.timeline = &*timeline;
+    }
 
-        inspectCursor->SetPosition(item.pos);
+    // Ctrl+Break can only be checked on this thread, which owns the debug client.
+    RunTrackWorkers(session, rootItem, workerSources, [&]() {
+        if (CheckControlC()) budget.Interrupt();
+        std::string progress = budget.TakeProgressLine();
+        if (!progress.empty()) dprintf("%s", progress.c_str());
+    });
 
-        Position foundPos = Position::Invalid;
+    if (persist) {
+        SaveWriterCacheFile(cachePath, cacheIdentity);
+    }
 
-        if (item.type == ZYDIS_OPERAND_TYPE_REGISTER) {
-            foundPos = FindRegisterWrite(inspectCursor.get(), item.reg);
+    if (timeline) {
+        if (timeline->Write(options.timelinePath)) {
+            dprintf("Timeline of %zu work items written to %s\n", timeline->GetEventCount(), options.timelinePath.c_str());
         }
         else {
-            foundPos = FindMemoryWrite(inspectCursor.get(), item.memAddr, item.memSize);
+            dprintf("ERROR: Cannot write %s\n", options.timelinePath.c_str());
         }
+    }
 
-        if (foundPos == Position::Invalid) continue;
-        
-        // Disassemble
+    tree.Finalize();
 
-        GlobalContext ctx = GetGlobalContext(inspectCursor.get());
+    // The printers resolve a symbol per node; with -stream that already happened during the run.
+    CComQIPtr<IDebugSymbols3> symbols(client);
+    if (symbols && !options.streamOutput) {
+        g_SymbolCache.Prefetch(symbols, std::vector<uint64_t>(session.pcs.begin(), session.pcs.end()));
+    }
 
-        char buffer[256];
-        BufferView bufferView{ buffer, sizeof(buffer) };
-        inspectCursor->QueryMemoryBuffer(inspectCursor->GetProgramCounter(), bufferView);
+    if (session.windowMisses != 0) {
+        dprintf("%d searches were not found within the lookback window.\n", (int)session.windowMisses);
+    }
 
-        ZydisDecodedInstruction instruction;
-        ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT];
+    if (const char* stopReason = budget.GetStopReason()) {
+        dprintf("Tracking stopped early (%s), showing the %zu records found so far.\n", stopReason, tree.Size());
+    }
+    return tree;
+}
 
-        if (ZYAN_FAILED(ZydisDecoderDecodeFull(&decoder, bufferView.BaseAddress, bufferView.Size, &instruction, operands))) {
-            continue;
-        }
+// Parses one "-name[:value]" switch of !timetrack. Returns false for unknown switches.
+static bool ParseTimeTrackOption(const std::string& token, TimeTrackOptions& options)
+{
+    std::string name = token.substr(1);
+    std::string value;
 
-        auto AddItem = [&](ZydisDecodedOperand& op) {
-                int uniqueId = ++idCounter;
-
-                TraceRecord record = {};
-                record.id = uniqueId;
-                record.parentId = item.id; // û θ 忡 
-                record.pos = foundPos;     //  ɾ ġ
-
-                outFile.write((char*)&record, sizeof(TraceRecord)); //  !
-
-                WorkItem newItem;
-                newItem.id = uniqueId;       //   ID   θ 
-                newItem.parentId = item.id;
-                newItem.pos = foundPos; //  ġ 
-
-                bool isValid = false;
-
-                if (op.type == ZYDIS_OPERAND_TYPE_MEMORY) {
-                    uint64_t base = op.mem.base == ZYDIS_REGISTER_NONE ? 0 : (uint64_t)GetRegisterValue(ctx, op.mem.base, false);
-                    uint64_t index = op.mem.index == ZYDIS_REGISTER_NONE ? 0 : (uint64_t)GetRegisterValue(ctx, op.mem.index, false);
-                    uint64_t scale = (op.mem.scale == 0) ? 1 : op.mem.scale;
-
-                    newItem.type = ZYDIS_OPERAND_TYPE_MEMORY;
-                    newItem.memAddr = base + (index * scale) + op.mem.disp.value;
-                    newItem.memSize = op.size / 8;
-                    if (newItem.memSize == 0) newItem.memSize = 8;
-                    isValid = true;
-                }
-                else if (op.type == ZYDIS_OPERAND_TYPE_REGISTER) {
-                    newItem.type = ZYDIS_OPERAND_TYPE_REGISTER;
-                    newItem.reg = ZydisRegisterGetLargestEnclosing(ZYDIS_MACHINE_MODE_LONG_64, op.reg.value);
-
-                    newItem.memSize = _ZydisGetRegisterWidth(g_TargetCPUType, newItem.reg) / 8;
-                    isValid = true;
-                }
-
-                if (isValid) {
-                    queue.push_back(newItem);
-                }
-        };
-
-        if (instruction.mnemonic == ZYDIS_MNEMONIC_LEA) {
-            const ZydisDecodedOperand* memOp = &operands[1];
-            if (memOp->type == ZYDIS_OPERAND_TYPE_MEMORY) {
-                // LEA Base Index    Ͽ 
-                if (memOp->mem.base != ZYDIS_REGISTER_NONE) {
-                    //  ۷ ü  ó
-                    ZydisDecodedOperand tmpOp = *memOp;
-                    tmpOp.type = ZYDIS_OPERAND_TYPE_REGISTER; //   Ÿ ȯϿ 
-                    tmpOp.reg.value = memOp->mem.base;
-                    AddItem(tmpOp);
-                }
-                if (memOp->mem.index != ZYDIS_REGISTER_NONE) {
-                    ZydisDecodedOperand tmpOp = *memOp;
-                    tmpOp.type = ZYDIS_OPERAND_TYPE_REGISTER;
-                    tmpOp.reg.value = memOp->mem.index;
-                    AddItem(tmpOp);
-                }
-            }
-        }
-        else {
-            // Ϲ ɾ ó (MOV, ADD, SUB, POP, PUSH, XCHG   )
-            // 'б(Read)' Ӽ ִ  ۷   ִ θԴϴ.
-            // ZydisDecoderDecodeFull Explicit() ۷ Implicit(Ͻ) ۷带  ȯմϴ.
-            // : POP RAX -> Explicit: RAX(Write), Implicit: RSP(Read/Write), Implicit: [RSP](Read)
-
-            std::set<ZydisRegister> processedRegs;
-
-            for (int i = 0; i < instruction.operand_count; i++) {
-                if (operands[i].actions & ZYDIS_OPERAND_ACTION_READ) {
-
-                    if (operands[i].type != ZYDIS_OPERAND_TYPE_REGISTER &&
-                        operands[i].type != ZYDIS_OPERAND_TYPE_MEMORY) {
-                        continue;
-                    }
-
-                    // Flags (RFLAGS/EFLAGS) б  帧     Ƿ ϴ  ϴ.
-                    if (operands[i].type == ZYDIS_OPERAND_TYPE_REGISTER &&
-                        (operands[i].reg.value == ZYDIS_REGISTER_RFLAGS || operands[i].reg.value == ZYDIS_REGISTER_EFLAGS)) {
-                        continue;
-                    }
-
-                    if (operands[i].type == ZYDIS_OPERAND_TYPE_REGISTER) {
-                        ZydisRegister enclosingReg = ZydisRegisterGetLargestEnclosing(ZYDIS_MACHINE_MODE_LONG_64, operands[i].reg.value);
-
-                        // ̹ ̹ ɾ  ͸ óߴٸ ǳʶ
-                        if (processedRegs.find(enclosingReg) != processedRegs.end()) {
-                            continue;
-                        }
-                        processedRegs.insert(enclosingReg);
-                    }
-
-                    AddItem(operands[i]);
-                }
-            }
-        }
+    size_t sep = name.find(':');
+    if (sep != std::string::npos) {
+        value = name.substr(sep + 1);
+        name = name.substr(0, sep);
     }
 
-    outFile.close();
+    if (name == "index") {
+        options.useWriterIndex = true;
+        if (!value.empty()) options.indexWindowSteps = std::stoull(value, nullptr, 0);
+        return true;
+    }
 
-    std::ifstream inFile(tempFile, std::ios::binary);
-    if (!inFile.is_open()) {
-        dprintf("Error reading trace file.\n");
-        return tree;
+    if (name == "exactdefs") {
+        options.exactRegisterDefs = true;
+        return true;
     }
 
-    TraceRecord rec;
+    if (name == "time" || name == "steps" || name == "qtime" || name == "qsteps") {
+        if (value.empty()) return false;
+        uint64_t limit = std::stoull(value, nullptr, 0);
 
-    while (inFile.read((char*)&rec, sizeof(TraceRecord))) {
-        tree[rec.parentId].push_back(rec);
+        if (name == "time") options.timeBudgetMs = limit;
+        else if (name == "steps") options.replayStepBudget = limit;
+        else if (name == "qtime") options.queryTimeMs = limit;
+        else options.queryStepBudget = limit;
+        return true;
     }
 
-    inFile.close();
+    if (name == "window") {
+        if (value.empty()) return false;
+        if (value == "frame") options.frameWindow = true;
+        else options.windowSteps = std::stoull(value, nullptr, 0);
+        return true;
+    }
 
-    DeleteFileA(tempFile.c_str());
-    return tree;
+    if (name == "allthreads") {
+        options.allThreadMemory = true;
+        return true;
+    }
+
+    if (name == "batch") {
+        if (value.empty()) return false;
+        options.memoryBatchSize = std::stoul(value, nullptr, 0);
+        if (options.memoryBatchSize == 0) options.memoryBatchSize = 1;
+        return true;
+    }
+
+    if (name == "bytes") {
+        options.splitMemory = true;
+        return true;
+    }
+
+    if (name == "persist") {
+        options.persistCache = true;
+        return true;
+    }
+
+    if (name == "timeline") {
+        if (value.empty()) return false;
+        options.timelinePath = value;
+        return true;
+    }
+
+    if (name == "stream") {
+        options.streamOutput = true;
+        return true;
+    }
+
+    if (name == "spill") {
+        if (value.empty()) return false;
+        options.spillThreshold = std::stoull(value, nullptr, 0);
+        return true;
+    }
+
+    if (name == "jobs" || name == "j") {
+        options.workerCount = value.empty() ? std::thread::hardware_concurrency() : std::stoul(value, nullptr, 0);
+        if (options.workerCount == 0) options.workerCount = 1;
+        return true;
+    }
+
+    return false;
 }
 
 HRESULT CALLBACK timetrack(IDebugClient* const pClient, const char* const pArgs) noexcept
@@ -447,7 +438,24 @@ try
     // 1.  ȿ ˻
     if (pArgs == nullptr || strlen(pArgs) == 0)
     {
-        dprintf("Usage: !timetrack <target> <size> <Max Steps=50> <gui>\n");
+        dprintf("Usage: !timetrack <target> <size> <Max Steps=50> <gui> [options]\n");
+        dprintf("Options:\n");
+        dprintf("  -index[:steps]  replay the window once and answer every step from a last-writer index (at most 16M writes)\n");
+        dprintf("  -exactdefs      stop at the instruction that writes a register even if the value is unchanged\n");
+        dprintf("  -jobs[:n]       process work items on n cursors in parallel (default: one per CPU)\n");
+        dprintf("  -time:ms        stop the whole run after ms milliseconds (Ctrl+Break also stops it)\n");
+        dprintf("  -steps:n        stop the whole run after n replayed steps\n");
+        dprintf("  -qtime:ms       give up a single write search after ms milliseconds\n");
+        dprintf("  -qsteps:n       give up a single write search after n replayed steps\n");
+        dprintf("  -window:n       look at most n steps back for each write (\"not found within window\" otherwise)\n");
+        dprintf("  -window:frame   look back only to the call that entered the current function\n");
+        dprintf("  -allthreads     replay every thread for stack memory of the current thread too\n");
+        dprintf("  -batch:n        resolve up to n nearby memory items with one replay (default 16, 1 = off)\n");
+        dprintf("  -bytes          keep searching the bytes of a memory location a partial write did not cover\n");
+        dprintf("  -persist        reuse and extend the write search results saved in <trace>.ttcache\n");
+        dprintf("  -timeline:file  write a Chrome trace-event timeline of every work item (chrome://tracing, Perfetto)\n");
+        dprintf("  -stream         print every node as soon as it is found, in id order\n");
+        dprintf("  -spill:n        keep at most n records in memory, then move them to a mapped temp file\n");
         dprintf("Example: !timetrack @rbp+30 8 100\n");
         dprintf("Example: !timetrack 0x7ff7a000 4\n");
         return S_OK;
@@ -455,36 +463,44 @@ try
 
     std::stringstream ss(pArgs);
 
-    std::string targetStr;
-    std::string sizeStr;
-    std::string maxStepsStr;
-    std::string guiStr;
-    ss >> targetStr;
-
-    unsigned int size = 0;
-    unsigned int maxSteps = 50;
+    std::vector<std::string> positional;
+    TimeTrackOptions options;
     bool showGui = false;
 
-    if (ss >> sizeStr) {
-        size = std::stoul(sizeStr, nullptr, 0);
-    }
-
-    if (ss >> maxStepsStr) {
-        if (maxStepsStr == "gui") {
+    std::string token;
+    while (ss >> token) {
+        if (token == "gui") {
             showGui = true;
         }
+        else if (token.starts_with("-")) {
+            if (!ParseTimeTrackOption(token, options)) {
+                dprintf("Unknown option: %s\n", token.c_str());
+                return S_OK;
+            }
+        }
         else {
-            maxSteps = std::stoul(maxStepsStr, nullptr, 0);
+            positional.push_back(token);
         }
     }
 
-    if (ss >> guiStr) {
-        if (guiStr == "gui") {
-            showGui = true;
-        }
+    if (positional.empty()) {
+        dprintf("Missing target.\n");
+        return S_OK;
     }
 
-    g_LastTraceTree = _TimeTrack(pClient, targetStr, size, maxSteps);
+    std::string targetStr = positional[0];
+    unsigned int size = 0;
+    unsigned int maxSteps = 50;
+
+    if (positional.size() > 1) {
+        size = std::stoul(positional[1], nullptr, 0);
+    }
+
+    if (positional.size() > 2) {
+        maxSteps = std::stoul(positional[2], nullptr, 0);
+    }
+
+    g_LastTraceTree = _TimeTrack(pClient, targetStr, size, maxSteps, options);
 
     if (showGui && track_gui) {
 
@@ -494,8 +510,133 @@ try
         //if (tid != 0) PostThreadMessage(tid, WM_TTGUI_COMMAND, (WPARAM)13, (LPARAM)pClient);
         //else PostMessage(HWND_BROADCAST, WM_TTGUI_COMMAND, (WPARAM)13, (LPARAM)pClient);
     }
-    else PrintRecordTreeIterative(pClient, g_LastTraceTree);
+    else if (!options.streamOutput) {
+        ScopedPhaseTimer timer(TrackPhase::Output);
+        PrintRecordTreeIterative(pClient, g_LastTraceTree);
+    }
+
+    return S_OK;
+}
+catch (const std::exception& e)
+{
+    dprintf("ERROR: %s\n", e.what());
+    return E_FAIL;
+}
+catch (...)
+{
+    return E_UNEXPECTED;
+}
+
+
+HRESULT CALLBACK ttcache(IDebugClient* const pClient, const char* const pArgs) noexcept
+try
+{
+    std::string args = pArgs ? pArgs : "";
+
+    if (args.find("clear") != std::string::npos) {
+        g_WriterCache.Clear();
+        g_DecodeCache.Clear();
+        g_SymbolCache.Clear();
+        dprintf("Write search, decode and symbol caches cleared.\n");
+        return S_OK;
+    }
+
+    uint64_t hits = g_WriterCache.GetHits();
+    uint64_t misses = g_WriterCache.GetMisses();
+    uint64_t total = hits + misses;
+
+    dprintf("Write search cache: %zu locations, %zu intervals\n", g_WriterCache.GetLocationCount(), g_WriterCache.GetIntervalCount());
+    dprintf("  hits %llu, misses %llu (%.1f%% hit rate)\n", hits, misses, total ? hits * 100.0 / total : 0.0);
+    if (g_WriterCacheFile.IsOpen()) {
+        dprintf("  %ws: %zu saved results, %llu hits\n", g_WriterCacheFile.GetPath().c_str(), g_WriterCacheFile.GetEntryCount(), g_WriterCache.GetFileHits());
+    }
+
+    uint64_t decodeHits = g_DecodeCache.GetHits();
+    uint64_t decodeMisses = g_DecodeCache.GetMisses();
+    uint64_t decodeTotal = decodeHits + decodeMisses;
+
+    dprintf("Decode cache: %zu instructions\n", g_DecodeCache.GetEntryCount());
+    dprintf("  hits %llu, misses %llu (%.1f%% hit rate), %llu invalidated by changed code\n",
+        decodeHits, decodeMisses, decodeTotal ? decodeHits * 100.0 / decodeTotal : 0.0, g_DecodeCache.GetInvalidations());
+
+    uint64_t symbolHits = g_SymbolCache.GetHits();
+    uint64_t symbolMisses = g_SymbolCache.GetMisses();
+    uint64_t symbolTotal = symbolHits + symbolMisses;
+
+    dprintf("Symbol cache: %zu function ranges\n", g_SymbolCache.GetFunctionCount());
+    dprintf("  hits %llu, lookups %llu (%.1f%% hit rate)\n", symbolHits, symbolMisses, symbolTotal ? symbolHits * 100.0 / symbolTotal : 0.0);
+    return S_OK;
+}
+catch (const std::exception& e)
+{
+    dprintf("ERROR: %s\n", e.what());
+    return E_FAIL;
+}
+catch (...)
+{
+    return E_UNEXPECTED;
+}
+
+// !ttstats [json [file] | clear]: phase timers and counters of the last !timetrack run.
+HRESULT CALLBACK ttstats(IDebugClient* const pClient, const char* const pArgs) noexcept
+try
+{
+    std::stringstream ss(pArgs ? pArgs : "");
+    std::string command, path;
+    ss >> command >> path;
+
+    if (command == "clear") {
+        g_TrackStats.Reset();
+        dprintf("Tracking statistics cleared.\n");
+        return S_OK;
+    }
+
+    if (command == "json") {
+        std::string json = g_TrackStats.ToJson();
+        if (path.empty()) {
+            dprintf("%s\n", json.c_str());
+            return S_OK;
+        }
 
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file || !(file << json << "\n")) {
+            dprintf("ERROR: Cannot write %s\n", path.c_str());
+            return E_FAIL;
+        }
+        dprintf("Statistics written to %s\n", path.c_str());
+        return S_OK;
+    }
+
+    if (!command.empty()) {
+        dprintf("Usage: !ttstats [json [file] | clear]\n");
+        return S_OK;
+    }
+
+    double runMs = g_TrackStats.GetNanoseconds(TrackPhase::Track) / 1e6;
+
+    dprintf("Phases (nested: replay includes its callbacks, output its symbol lookups):\n");
+    for (size_t i = 0; i < (size_t)TrackPhase::Count; i++) {
+        TrackPhase phase = (TrackPhase)i;
+        double ms = g_TrackStats.GetNanoseconds(phase) / 1e6;
+        dprintf("  %-10s %10llu calls %12.1f ms", TrackStats::GetName(phase), g_TrackStats.GetCalls(phase), ms);
+        if (phase != TrackPhase::Track && phase != TrackPhase::Output && runMs > 0) {
+            dprintf(" %6.1f%% of the run", ms * 100.0 / runMs);
+        }
+        dprintf("\n");
+    }
+
+    dprintf("Counters:\n");
+    for (size_t i = 0; i < (size_t)TrackCounter::Count; i++) {
+        TrackCounter counter = (TrackCounter)i;
+        dprintf("  %-16s %llu\n", TrackStats::GetName(counter), g_TrackStats.Get(counter));
+    }
+
+    dprintf("Replayed steps per search (max %llu):\n", g_TrackStats.GetMaxDistance());
+    for (size_t i = 0; i < TrackStats::c_distanceBuckets; i++) {
+        uint64_t count = g_TrackStats.GetDistanceCount(i);
+        if (count == 0) continue;
+        dprintf("  >= %-14llu %llu\n", TrackStats::GetBucketStart(i), count);
+    }
     return S_OK;
 }
 catch (const std::exception& e)
@@ -506,4 +647,4 @@ catch (const std::exception& e)
 catch (...)
 {
     return E_UNEXPECTED;
-}
\ No newline at end of file
+}
@@ -4,6 +4,9 @@
 #include <TTD/IReplayEngineStl.h>
 #include "Formatters.h"
 #include "disasm_helper.h"
+#include "DecodeCache.h"
+#include "SymbolCache.h"
+#include "ReplayTraceSource.h"
 #include <deque>
 
 extern IReplayEngineView* g_pReplayEngine;
@@ -36,7 +39,7 @@ std::wstring GetConfigFilePathInDll() {
     return fullPath;
 }
 
-void LoadTraceDataToTree(TimeTrackGUI::UITreeView* uiTree, std::map<int, std::vector<TraceRecord>>& treeData, int rootId) {
+void LoadTraceDataToTree(TimeTrackGUI::UITreeView* uiTree, const TraceRecordStore& treeData, int rootId) {
     CComPtr<IDebugClient> client;
     if (FAILED(DebugCreate(IID_PPV_ARGS(&client))))return;
 
@@ -44,35 +47,24 @@ void LoadTraceDataToTree(TimeTrackGUI::UITreeView* uiTree, std::map<int, std::ve
 
     if (!symbols) return;
 
-    ZydisDecoder decoder;
-    SetupZydisDecoder(&decoder, g_TargetCPUType);
-
-    ZydisFormatter formatter;
-    ZydisFormatterInit(&formatter, ZYDIS_FORMATTER_STYLE_INTEL);
-
-    char buffer[256];
-    BufferView bufferView{ buffer, sizeof(buffer) };
-    ZydisDecodedInstruction instruction;
-    ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT];
 
     UniqueCursor inspectCursor(g_pReplayEngine->NewCursor());
 
     struct StackState {
-        const TraceRecord* record = nullptr;
+        int id = 0;
         int depth = 0;
         TimeTrackGUI::TreeNode* parentNode = nullptr;
     };
 
     std::deque<StackState> workStack;
 
+    std::set<int> referenced = CollectReferencedIds(treeData);
+
     // 2. Ʈ ã
-    auto rootIt = treeData.find(rootId);
-    if (rootIt != treeData.end()) {
-        const auto& children = rootIt->second;
-        for (auto it = children.rbegin(); it != children.rend(); ++it) {
-            // Ʈ θ nullptr
-            workStack.push_back({ &(*it), 0, nullptr });
-        }
+    auto rootChildren = treeData.GetChildren(rootId);
+    for (auto it = rootChildren.rbegin(); it != rootChildren.rend(); ++it) {
+        // Ʈ θ nullptr
+        workStack.push_back({ (int)*it, 0, nullptr });
     }
 
 
@@ -80,45 +72,53 @@ void LoadTraceDataToTree(TimeTrackGUI::UITreeView* uiTree, std::map<int, std::ve
         StackState current = workStack.back();
         workStack.pop_back();
 
-        const TraceRecord& record = *current.record;
+        TraceRecord record = treeData.Get(current.id);
 
-        inspectCursor->SetPosition(record.pos);
+        inspectCursor->SetPosition(ReplayTraceSource::ToPosition(record.pos));
 
         uint64_t curIP = (uint64_t)inspectCursor->GetProgramCounter();
 
         std::string output;
 
-        output = std::format("{} | ", record.pos);
+        if (record.refId != 0) {
+            output = std::format("=> #{} | ", record.refId);
+        }
+        else if (referenced.count(record.id)) {
+            output = std::format("#{} | ", record.id);
+        }
+
+        output += std::format("{} | ", record.pos);
 
-        uint64_t uDisp;
-        symbols->GetNameByOffset(curIP, buffer, sizeof(buffer), NULL, &uDisp);
-        output += std::format("{}+{:X}", buffer, uDisp);
+        SymbolName symbol = g_SymbolCache.Get(symbols, curIP);
+        output += std::format("{}+{:X}", symbol.name, symbol.displacement);
         output += "\t";
 
-        inspectCursor->QueryMemoryBuffer((GuestAddress)curIP, bufferView);
+        if (auto decoded = g_DecodeCache.Get(inspectCursor.get())) {
+            output += decoded->text;
+        }
+
+        if (record.byteCount != 0) {
+            output += std::format("\t(bytes {}-{})", record.byteOffset, record.byteOffset + record.byteCount - 1);
+        }
 
-        if (ZYAN_SUCCESS(ZydisDecoderDecodeFull(&decoder, buffer, 16, &instruction, operands))) {
-            ZydisFormatterFormatInstruction(&formatter, &instruction, operands, instruction.operand_count_visible, buffer, sizeof(buffer), curIP, ZYAN_NULL);
-            output += buffer;
+        if (record.flags & TraceRecordOutsideWindow) {
+            output += "\t(not found within window)";
         }
 
         std::wstring wLineStr(output.begin(), output.end());
 
         TimeTrackGUI::TreeNode* newNode = nullptr;
         if (current.parentNode == nullptr) {
-            newNode = uiTree->AddRootNode(wLineStr, record.id, record.pos);
+            newNode = uiTree->AddRootNode(wLineStr, record.id, ReplayTraceSource::ToPosition(record.pos));
         }
         else {
-            newNode = uiTree->AddChildNode(current.parentNode, wLineStr, record.id, record.pos);
+            newNode = uiTree->AddChildNode(current.parentNode, wLineStr, record.id, ReplayTraceSource::ToPosition(record.pos));
         }
 
         // ڽ  ó
-        auto childIt = treeData.find(record.id);
-        if (childIt != treeData.end()) {
-            const auto& children = childIt->second;
-            for (auto it = children.rbegin(); it != children.rend(); ++it) {
-                workStack.push_back({ &(*it), current.depth + 1, newNode }); // θ newNode 
-            }
+        auto children = treeData.GetChildren(record.id);
+        for (auto it = children.rbegin(); it != children.rend(); ++it) {
+            workStack.push_back({ (int)*it, current.depth + 1, newNode }); // θ newNode 
         }
 
         // ǻ Ʈ  ĵ
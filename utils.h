@@ -8,4 +8,4 @@
 #include <atlcomcli.h>
 
 std::wstring GetConfigFilePathInDll();
-void LoadTraceDataToTree(TimeTrackGUI::UITreeView* uiTree, std::map<int, std::vector<TraceRecord>>& treeData, int rootId);
\ No newline at end of file
+void LoadTraceDataToTree(TimeTrackGUI::UITreeView* uiTree, const TraceRecordStore& treeData, int rootId);
\ No newline at end of file